@@ -1,112 +1,934 @@
 #include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/gpio/driver.h>
+#include <linux/gpio/machine.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/cdev.h>
-#include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/moduleparam.h>
+#include <linux/input.h>
 #include <linux/sched.h>
 #include <linux/uaccess.h>
 #include <linux/wait.h>
 #include <linux/poll.h>
+#include <linux/kfifo.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/idr.h>
+#include <linux/kref.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+#include <linux/of.h>
+#include <linux/mod_devicetable.h>
+#include <linux/platform_device.h>
+
+#include "rotary_ioctl.h"
 
 #define DRIVER_NAME "rotary_device_driver"
-#define S1_GPIO 5 
-#define S2_GPIO 6 
-#define SW_GPIO 13 
-#define DEBOUNCE_MS 150 
-#define ROTARY_DEBOUNCE_MS 10 
-
-static dev_t device_number;
-static struct cdev rotary_cdev;
+#define ROTARY_MAX_DEVICES 4
+#define ROTARY_FIFO_SIZE 64 // 2의 거듭제곱
+#define ROTARY_LAT_BUCKETS 16 // [2^b, 2^(b+1)) us, 마지막 칸은 그 이상 전부
+
+/* IRQ 하나당 이벤트 하나 (고정 크기), type 값은 ROTARY_REC_*와 같음 */
+enum { ROTARY_EV_ROTATE = ROTARY_REC_ROTATE, ROTARY_EV_BUTTON = ROTARY_REC_BUTTON };
+
+struct rotary_event {
+    u64 ts_ns;    // ktime_get_ns() at IRQ
+    s32 value;    // 이벤트 직후 누적 회전값
+    s16 delta;    // 회전: +-1 (가속 시 +-accel_max까지), 버튼: 0
+    u8  type;
+    u8  button;   // 1: 뗌, 0: 누름
+};
+
+/*
+ * DT/보드 설정이 없는 기존 배선: 인코더 하나를 GPIO 5/6/13에 생성.
+ * gpio_chip을 주면 번호를 그 칩의 오프셋으로 보고 lookup table을 만듦
+ * (gpio-sim / gpio-mockup으로 하드웨어 없이 테스트할 때).
+ */
+static bool legacy = true;
+module_param(legacy, bool, 0444);
+MODULE_PARM_DESC(legacy, "Create one encoder on s1_gpio/s2_gpio/sw_gpio without a DT node");
+
+static int s1_gpio = 5;
+module_param(s1_gpio, int, 0444);
+MODULE_PARM_DESC(s1_gpio, "Legacy encoder: S1 (A) line");
+
+static int s2_gpio = 6;
+module_param(s2_gpio, int, 0444);
+MODULE_PARM_DESC(s2_gpio, "Legacy encoder: S2 (B) line");
+
+static int sw_gpio = 13;
+module_param(sw_gpio, int, 0444);
+MODULE_PARM_DESC(sw_gpio, "Legacy encoder: push button line, -1 = none");
+
+static char *gpio_chip;
+module_param(gpio_chip, charp, 0444);
+MODULE_PARM_DESC(gpio_chip, "Legacy encoder: treat the numbers as offsets on this gpiochip label");
+
+/* 버튼 디바운스: 마지막 엣지 후 이 시간 동안 조용하면 레벨을 확정 */
+static unsigned int sw_debounce_us = 5000;
+module_param(sw_debounce_us, uint, 0644);
+MODULE_PARM_DESC(sw_debounce_us, "Button settle time in microseconds");
+
+/* evdev 백엔드: REL_DIAL(회전) + KEY_ENTER(버튼) */
+static bool input_events;
+module_param(input_events, bool, 0444);
+MODULE_PARM_DESC(input_events, "Also report events through an input device (evdev)");
+
+/*
+ * 가속 곡선: 디텐트 간격이 accel_slow_ms 이상이면 x1, accel_fast_ms 이하면
+ * x accel_max, 그 사이는 선형 보간. accel_max = 1 이면 끔 (기본값).
+ * 방향이 바뀐 첫 디텐트는 항상 x1 (되돌릴 때 튀지 않도록).
+ * /sys/module/rotary/parameters/ 에서 실행 중에 바꿀 수 있음.
+ */
+static unsigned int accel_max = 1;
+module_param(accel_max, uint, 0644);
+MODULE_PARM_DESC(accel_max, "Maximum delta per detent when turning fast (1 = no acceleration)");
+
+static unsigned int accel_slow_ms = 40;
+module_param(accel_slow_ms, uint, 0644);
+MODULE_PARM_DESC(accel_slow_ms, "Detent interval in ms at or above which acceleration is x1");
+
+static unsigned int accel_fast_ms = 8;
+module_param(accel_fast_ms, uint, 0644);
+MODULE_PARM_DESC(accel_fast_ms, "Detent interval in ms at or below which acceleration is accel_max");
+
+enum { ROTARY_S1, ROTARY_S2, ROTARY_SW, ROTARY_NR_LINES };
+
+struct rotary_dev;
+
+/* 입력 라인 하나 = GPIO + IRQ. dev_id로 넘겨 어느 라인인지 구분 */
+struct rotary_line {
+    struct rotary_dev *dev;
+    struct gpio_desc *gpio;
+    int irq;
+    u64 ts_ns;    // hard IRQ 시각 (ONESHOT이라 스레드가 끝날 때까지 덮어쓰이지 않음)
+    u64 irqs;     // 이 라인의 IRQ 수 (hard 핸들러만 갱신)
+};
+
+/* 인코더 한 개 (/dev/rotary_device_driver, /dev/rotary_device_driverN) */
+struct rotary_dev {
+    struct device *parent;
+    int id;
+    dev_t dev_num;
+    struct cdev *cdev;           // 열린 파일이 remove 뒤에도 잡고 있을 수 있어 따로 할당
+    struct rotary_line line[ROTARY_NR_LINES];
+
+    /*
+     * probe(devm action)와 열린 파일마다 하나씩. 마지막 put에서 해제.
+     * dead는 remove에서 lock 아래 설정, 이후 read/poll/ioctl은 ENODEV.
+     */
+    struct kref ref;
+    bool dead;
+
+    spinlock_t lock;             // clients, value, button, dropped
+    struct list_head clients;
+    long value;
+    int button;                  // 1: 뗌, 0: 누름 (Active Low)
+    unsigned long dropped;
+    wait_queue_head_t wait;
+
+    /* 통계 (debugfs): queued/lat_hist는 lock, 나머지는 각 락 아래 */
+    u64 queued;                  // 적재된 이벤트 (client 수와 무관하게 1건)
+    u64 quad_rejected;           // 디텐트를 끝내지 못하고 되돌아간 S1/S2 엣지
+    u64 sw_rejected;             // 바운스로 묶여 버려진 버튼 엣지 + 변화 없는 글리치
+    u64 lat_hist[ROTARY_LAT_BUCKETS]; // IRQ -> read() 전달 지연
+    struct dentry *debugfs;
+
+    struct mutex state_lock;     // S1/S2 IRQ 스레드가 동시에 돌 수 있음
+    u8 state;
+    u64 last_ns;                 // 직전 디텐트 시각
+    int last_dir;
+
+    struct hrtimer sw_timer;
+    spinlock_t sw_lock;
+    u64 sw_edge_ns;              // 바운스 묶음의 첫 엣지 시각, 0이면 대기 중 아님
+    int sw_level;                // 마지막 엣지 직후 읽은 레벨
+
+    struct input_dev *input;
+};
+
 static struct class *rotary_class;
-static int interrupt_num_s1, interrupt_num_sw;
-static long rotary_value = 0;
-static int button_status = 1; // 1: 뗌, 0: 누름 (Active Low)
-static unsigned long last_rot_jiffies = 0, last_sw_jiffies = 0;
-static int data_ready = 0;
-static DECLARE_WAIT_QUEUE_HEAD(rotary_wait_queue);
+static dev_t rotary_devt;
+static DEFINE_IDR(rotary_idr);            // minor -> dev
+static DEFINE_MUTEX(rotary_idr_lock);     // idr + open의 kref_get
+static struct dentry *rotary_debugfs_root;
+
+/*
+ * open()마다 자기 이벤트 큐를 가짐 (evdev의 client와 같은 구조):
+ * UI 프로세스와 로깅 프로세스가 서로의 이벤트를 뺏지 않음.
+ * 넣기는 dev->lock(spinlock) 아래 IRQ에서, 빼기는 client->read_lock
+ * 아래 한 reader만 하므로 kfifo 자체는 lockless로 동작.
+ */
+struct rotary_client {
+    struct rotary_dev *dev;
+    struct list_head node;
+    struct mutex read_lock;
+    unsigned long dropped;
+    u32 format;       // ROTARY_FMT_*
+    s32 last_value;   // 바이너리 모드: 마지막으로 읽어 간 누적값 (delta 기준)
+    DECLARE_KFIFO(fifo, struct rotary_event, ROTARY_FIFO_SIZE);
+};
+
+/* IRQ 스레드/타이머: 상태 갱신 + 이벤트 적재 */
+static void rotary_push(struct rotary_dev *dev, u8 type, int delta, int button, u64 ts_ns)
+{
+    struct rotary_client *client;
+    struct rotary_event ev;
+    unsigned long flags;
+
+    ev.ts_ns = ts_ns;
+    ev.type = type;
+    ev.delta = delta;
+
+    spin_lock_irqsave(&dev->lock, flags);
+    dev->value += delta;
+    if (type == ROTARY_EV_BUTTON)
+        dev->button = button;
+    ev.value = dev->value;
+    ev.button = dev->button;
+    dev->queued++;
+    list_for_each_entry(client, &dev->clients, node) {
+        if (!kfifo_put(&client->fifo, ev)) {
+            client->dropped++;
+            dev->dropped++;
+        }
+    }
+
+    if (dev->input) {
+        input_set_timestamp(dev->input, ns_to_ktime(ts_ns));
+        if (type == ROTARY_EV_ROTATE)
+            input_report_rel(dev->input, REL_DIAL, delta);
+        else
+            input_report_key(dev->input, KEY_ENTER, !button); // Active Low
+        input_sync(dev->input);
+    }
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    wake_up_interruptible(&dev->wait);
+}
+
+static void rotary_dev_release(struct kref *ref)
+{
+    kfree(container_of(ref, struct rotary_dev, ref));
+}
+
+static void rotary_dev_put(struct rotary_dev *dev)
+{
+    kref_put(&dev->ref, rotary_dev_release);
+}
+
+static int rotary_open(struct inode *inode, struct file *file)
+{
+    struct rotary_dev *dev;
+    struct rotary_client *client;
+    unsigned long flags;
+
+    client = kzalloc(sizeof(*client), GFP_KERNEL);
+    if (!client)
+        return -ENOMEM;
+
+    mutex_lock(&rotary_idr_lock);
+    dev = idr_find(&rotary_idr, iminor(inode));
+    if (dev)
+        kref_get(&dev->ref);
+    mutex_unlock(&rotary_idr_lock);
+    if (!dev) {
+        kfree(client);
+        return -ENODEV;
+    }
 
+    client->dev = dev;
+    INIT_KFIFO(client->fifo);
+    mutex_init(&client->read_lock);
+    client->format = ROTARY_FMT_TEXT;
+
+    spin_lock_irqsave(&dev->lock, flags);
+    client->last_value = dev->value;
+    list_add_tail(&client->node, &dev->clients);
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    file->private_data = client;
+    return 0;
+}
+
+static int rotary_release(struct inode *inode, struct file *file)
+{
+    struct rotary_client *client = file->private_data;
+    struct rotary_dev *dev = client->dev;
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->lock, flags);
+    list_del(&client->node);
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    kfree(client);
+    rotary_dev_put(dev);
+    return 0;
+}
+
+/* remove 뒤에도 큐에 남은 이벤트는 읽을 수 있고, 다 읽으면 HUP */
 static unsigned int rotary_poll(struct file *file, poll_table *wait)
 {
-    poll_wait(file, &rotary_wait_queue, wait);
-    if (data_ready)
+    struct rotary_client *client = file->private_data;
+
+    poll_wait(file, &client->dev->wait, wait);
+    if (!kfifo_is_empty(&client->fifo))
         return POLLIN | POLLRDNORM;
+    if (READ_ONCE(client->dev->dead))
+        return POLLERR | POLLHUP;
     return 0;
 }
 
+/*
+ * 모든 라인 공용 hard IRQ: 시각만 찍고 나머지는 스레드에서.
+ * gpio-sim 같은 칩은 값 읽기가 sleep할 수 있어 GPIO 접근은 스레드 쪽.
+ */
+static irqreturn_t rotary_irq_stamp(int irq, void *dev_id) {
+    struct rotary_line *line = dev_id;
+
+    line->ts_ns = ktime_get_ns();
+    line->irqs++;
+    return IRQ_WAKE_THREAD;
+}
+
+/*
+ * 엣지마다 레벨을 읽고 타이머를 다시 걸어 바운스가 끝날 때까지 미룸.
+ * 이벤트 시각은 바운스 묶음의 첫 엣지 (실제로 누른/뗀 순간).
+ */
 static irqreturn_t rotary_sw_handler(int irq, void *dev_id) {
-    if (time_before(jiffies, last_sw_jiffies + msecs_to_jiffies(DEBOUNCE_MS))) return IRQ_HANDLED;
-    last_sw_jiffies = jiffies;
+    struct rotary_line *line = dev_id;
+    struct rotary_dev *dev = line->dev;
+    int level = !!gpiod_get_value_cansleep(line->gpio);
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->sw_lock, flags);
+    if (!dev->sw_edge_ns)
+        dev->sw_edge_ns = line->ts_ns;
+    else
+        dev->sw_rejected++; // 앞 엣지의 바운스
+    dev->sw_level = level;
+    hrtimer_start(&dev->sw_timer, ns_to_ktime((u64)sw_debounce_us * NSEC_PER_USEC), HRTIMER_MODE_REL);
+    spin_unlock_irqrestore(&dev->sw_lock, flags);
 
-    // 현재 버튼의 물리적 상태(0 또는 1)를 직접 읽음
-    button_status = gpio_get_value(SW_GPIO); 
-    data_ready = 1;
-    wake_up_interruptible(&rotary_wait_queue);
     return IRQ_HANDLED;
 }
 
-static irqreturn_t rotary_int_handler(int irq, void *dev_id) {
-    if (time_before(jiffies, last_rot_jiffies + msecs_to_jiffies(ROTARY_DEBOUNCE_MS))) return IRQ_HANDLED;
-    last_rot_jiffies = jiffies;
+/* 조용해진 뒤의 레벨이 바뀌었을 때만 이벤트 (짧은 글리치는 무시) */
+static enum hrtimer_restart rotary_sw_settled(struct hrtimer *t) {
+    struct rotary_dev *dev = container_of(t, struct rotary_dev, sw_timer);
+    unsigned long flags;
+    u64 edge_ns;
+    int level;
+
+    spin_lock_irqsave(&dev->sw_lock, flags);
+    edge_ns = dev->sw_edge_ns;
+    dev->sw_edge_ns = 0;
+    level = dev->sw_level;
+    if (level == READ_ONCE(dev->button))
+        dev->sw_rejected++; // 제자리로 돌아온 글리치
+    spin_unlock_irqrestore(&dev->sw_lock, flags);
+
+    if (level != READ_ONCE(dev->button))
+        rotary_push(dev, ROTARY_EV_BUTTON, 0, level, edge_ns ? edge_ns : ktime_get_ns());
 
-    if (gpio_get_value(S1_GPIO) == 0) {
-        if (gpio_get_value(S2_GPIO) == 1) rotary_value--; 
-        else                             rotary_value++;
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Gray code 상태 머신 (full-step, 디텐트 = 11 상태).
+ * 입력 = (S1 << 1) | S2. 한 디텐트의 4단계 전이를 끝까지 거쳐 11로
+ * 돌아올 때만 방향이 나오고, 채터링은 이전 상태로 되돌아갈 뿐이라
+ * 시간 창 없이도 걸러짐.
+ *   S1 먼저 떨어짐: 11 -> 01 -> 00 -> 10 -> 11 = -1
+ *   S2 먼저 떨어짐: 11 -> 10 -> 00 -> 01 -> 11 = +1
+ */
+#define R_START     0x0
+#define R_DEC_FINAL 0x1
+#define R_DEC_BEGIN 0x2
+#define R_DEC_NEXT  0x3
+#define R_INC_BEGIN 0x4
+#define R_INC_FINAL 0x5
+#define R_INC_NEXT  0x6
+#define DIR_DEC     0x10
+#define DIR_INC     0x20
+
+static const u8 rotary_table[7][4] = {
+    /* R_START     */ { R_START,    R_DEC_BEGIN, R_INC_BEGIN, R_START },
+    /* R_DEC_FINAL */ { R_DEC_NEXT, R_START,     R_DEC_FINAL, R_START | DIR_DEC },
+    /* R_DEC_BEGIN */ { R_DEC_NEXT, R_DEC_BEGIN, R_START,     R_START },
+    /* R_DEC_NEXT  */ { R_DEC_NEXT, R_DEC_BEGIN, R_DEC_FINAL, R_START },
+    /* R_INC_BEGIN */ { R_INC_NEXT, R_START,     R_INC_BEGIN, R_START },
+    /* R_INC_FINAL */ { R_INC_NEXT, R_INC_FINAL, R_START,     R_START | DIR_INC },
+    /* R_INC_NEXT  */ { R_INC_NEXT, R_INC_FINAL, R_INC_BEGIN, R_START },
+};
+
+/* 디텐트 간격(ns) -> 배율. dev->state_lock 아래에서 호출 */
+static int rotary_accel(struct rotary_dev *dev, int dir, u64 now_ns)
+{
+    unsigned int max = READ_ONCE(accel_max);
+    unsigned int slow = READ_ONCE(accel_slow_ms);
+    unsigned int fast = READ_ONCE(accel_fast_ms);
+    u64 dt_ms = div_u64(now_ns - dev->last_ns, NSEC_PER_MSEC);
+    int mult = 1;
+
+    max = clamp(max, 1U, 100U);
+    if (max > 1 && dir == dev->last_dir && dev->last_ns && slow > fast) {
+        if (dt_ms <= fast)
+            mult = max;
+        else if (dt_ms < slow)
+            mult = 1 + div_u64((u64)(max - 1) * (slow - dt_ms), slow - fast);
     }
-    data_ready = 1;
-    wake_up_interruptible(&rotary_wait_queue);
+
+    dev->last_ns = now_ns;
+    dev->last_dir = dir;
+    return dir * mult;
+}
+
+/*
+ * S1, S2 양쪽 엣지 공용 (IRQ 스레드). 두 라인의 스레드가 동시에 돌 수
+ * 있어 핀 읽기와 전이를 같은 락 안에서 해야 순서가 뒤섞이지 않음.
+ * 읽기가 sleep할 수 있으므로 mutex.
+ */
+static irqreturn_t rotary_int_handler(int irq, void *dev_id) {
+    struct rotary_line *line = dev_id;
+    struct rotary_dev *dev = line->dev;
+    u64 now_ns = line->ts_ns;
+    u8 prev, pins;
+    int delta = 0;
+
+    mutex_lock(&dev->state_lock);
+    pins = (!!gpiod_get_value_cansleep(dev->line[ROTARY_S1].gpio) << 1) |
+           !!gpiod_get_value_cansleep(dev->line[ROTARY_S2].gpio);
+    prev = dev->state & 0x0F;
+    dev->state = rotary_table[prev][pins];
+    if (dev->state & DIR_DEC)
+        delta = rotary_accel(dev, -1, now_ns);
+    else if (dev->state & DIR_INC)
+        delta = rotary_accel(dev, 1, now_ns);
+    else if (dev->state == R_START && prev != R_START)
+        dev->quad_rejected++;
+    mutex_unlock(&dev->state_lock);
+
+    if (delta)
+        rotary_push(dev, ROTARY_EV_ROTATE, delta, 0, now_ns);
     return IRQ_HANDLED;
 }
 
+/* IRQ 시각 -> 지금(사용자에게 넘기는 순간)까지의 지연을 히스토그램에 */
+static void rotary_account_latency(struct rotary_dev *dev, u64 ts_ns)
+{
+    u64 us = div_u64(ktime_get_ns() - ts_ns, NSEC_PER_USEC);
+    unsigned long flags;
+    int b;
+
+    b = us ? ilog2(us) : 0;
+    spin_lock_irqsave(&dev->lock, flags);
+    dev->lat_hist[min(b, ROTARY_LAT_BUCKETS - 1)]++;
+    spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+/*
+ * 바이너리 모드: 변환 없이 레코드를 그대로 복사, count가 허락하는 만큼.
+ * client->read_lock 아래에서 호출.
+ */
+static ssize_t rotary_read_records(struct rotary_client *client, char __user *user_buf, size_t count) {
+    struct rotary_record rec = { };
+    struct rotary_event ev;
+    size_t len = 0;
+
+    while (len + sizeof(rec) <= count && kfifo_peek(&client->fifo, &ev)) {
+        rec.timestamp_ns = ev.ts_ns;
+        rec.value = ev.value;
+        rec.delta = ev.value - client->last_value;
+        rec.type = ev.type;
+        rec.button = ev.button;
+        rec.dropped = READ_ONCE(client->dropped);
+        if (copy_to_user(user_buf + len, &rec, sizeof(rec)))
+            return len ? len : -EFAULT;
+        client->last_value = ev.value;
+        kfifo_skip(&client->fifo);
+        rotary_account_latency(client->dev, ev.ts_ns);
+        len += sizeof(rec);
+    }
+    return len;
+}
+
+/*
+ * 큐에 쌓인 이벤트를 한 번에 읽음. 텍스트 모드는 이벤트당 한 줄
+ * "<누적값> <버튼> <IRQ 시각 ns>\n" (앞 두 필드는 기존 포맷과 동일)
+ */
 static ssize_t rotary_read(struct file *file, char __user *user_buf, size_t count, loff_t *ppos) {
-    char buff[64];
+    struct rotary_client *client = file->private_data;
+    struct rotary_event evs[16];
+    char buff[256];
+    size_t len = 0;
+    ssize_t nrec;
+    unsigned int i, nev, done = 0;
+    int n, ret;
+
+    if (client->format == ROTARY_FMT_BINARY && count < sizeof(struct rotary_record))
+        return -EINVAL;
+
+    if (mutex_lock_interruptible(&client->read_lock))
+        return -ERESTARTSYS;
 
-    if (!data_ready) {
+    while (kfifo_is_empty(&client->fifo)) {
+        mutex_unlock(&client->read_lock);
+        if (READ_ONCE(client->dev->dead))
+            return -ENODEV;
         if (file->f_flags & O_NONBLOCK)
             return -EAGAIN;
-        wait_event_interruptible(rotary_wait_queue, data_ready != 0);
+        ret = wait_event_interruptible(client->dev->wait,
+                                       !kfifo_is_empty(&client->fifo) ||
+                                       READ_ONCE(client->dev->dead));
+        if (ret)
+            return ret;
+        if (mutex_lock_interruptible(&client->read_lock))
+            return -ERESTARTSYS;
     }
 
-    int len = snprintf(buff, sizeof(buff), "%ld %d\n", rotary_value, button_status);
-    data_ready = 0;
+    if (client->format == ROTARY_FMT_BINARY) {
+        nrec = rotary_read_records(client, user_buf, count);
+        mutex_unlock(&client->read_lock);
+        return nrec;
+    }
+
+    // 먼저 꺼내지 않고 포맷만 한 뒤, 사용자 복사가 성공한 줄만 큐에서 뺀다
+    nev = kfifo_out_peek(&client->fifo, evs, ARRAY_SIZE(evs));
+    for (i = 0; i < nev; i++) {
+        n = snprintf(buff + len, sizeof(buff) - len, "%d %d %llu\n",
+                     evs[i].value, evs[i].button, evs[i].ts_ns);
+        if (len + n >= sizeof(buff) || len + n > count)
+            break;
+        len += n;
+        done++;
+    }
 
-    if (copy_to_user(user_buf, buff, len)) return -EFAULT;
+    if (!len) {
+        mutex_unlock(&client->read_lock);
+        return -EINVAL; // 버퍼가 한 줄도 못 담음
+    }
+    if (copy_to_user(user_buf, buff, len)) {
+        mutex_unlock(&client->read_lock);
+        return -EFAULT;
+    }
+    for (i = 0; i < done; i++) {
+        kfifo_skip(&client->fifo);
+        rotary_account_latency(client->dev, evs[i].ts_ns);
+    }
+    mutex_unlock(&client->read_lock);
     return len;
 }
 
+static long rotary_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    struct rotary_client *client = file->private_data;
+    u32 format;
+
+    if (READ_ONCE(client->dev->dead))
+        return -ENODEV;
+
+    switch (cmd) {
+    case ROTARY_IOC_SET_FORMAT:
+        if (get_user(format, (u32 __user *)arg))
+            return -EFAULT;
+        if (format != ROTARY_FMT_TEXT && format != ROTARY_FMT_BINARY)
+            return -EINVAL;
+        mutex_lock(&client->read_lock);
+        client->format = format;
+        mutex_unlock(&client->read_lock);
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
 static struct file_operations fops = {
-    .owner = THIS_MODULE,
-    .read  = rotary_read,
-    .poll  = rotary_poll,
+    .owner          = THIS_MODULE,
+    .open           = rotary_open,
+    .release        = rotary_release,
+    .read           = rotary_read,
+    .poll           = rotary_poll,
+    .unlocked_ioctl = rotary_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+};
+
+/* ================= debugfs ================= */
+
+static int rotary_stats_show(struct seq_file *m, void *unused)
+{
+    struct rotary_dev *dev = m->private;
+    unsigned long flags;
+
+    seq_printf(m, "irqs_s1:       %llu\n", READ_ONCE(dev->line[ROTARY_S1].irqs));
+    seq_printf(m, "irqs_s2:       %llu\n", READ_ONCE(dev->line[ROTARY_S2].irqs));
+    seq_printf(m, "irqs_sw:       %llu\n", READ_ONCE(dev->line[ROTARY_SW].irqs));
+    seq_printf(m, "quad_rejected: %llu\n", READ_ONCE(dev->quad_rejected));
+    seq_printf(m, "sw_rejected:   %llu\n", READ_ONCE(dev->sw_rejected));
+
+    spin_lock_irqsave(&dev->lock, flags);
+    seq_printf(m, "queued:        %llu\n", dev->queued);
+    seq_printf(m, "dropped:       %lu\n", dev->dropped);
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rotary_stats);
+
+static int rotary_lat_hist_show(struct seq_file *m, void *unused)
+{
+    struct rotary_dev *dev = m->private;
+    u64 hist[ROTARY_LAT_BUCKETS];
+    unsigned long flags;
+    int b;
+
+    spin_lock_irqsave(&dev->lock, flags);
+    memcpy(hist, dev->lat_hist, sizeof(hist));
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    seq_printf(m, "%10s %10s\n", "<us", "count");
+    for (b = 0; b < ROTARY_LAT_BUCKETS; b++)
+        seq_printf(m, "%10llu %10llu\n", 1ULL << (b + 1), hist[b]);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rotary_lat_hist);
+
+static void rotary_debugfs_init(struct rotary_dev *dev)
+{
+    dev->debugfs = debugfs_create_dir(dev_name(dev->parent), rotary_debugfs_root);
+    debugfs_create_file("stats", 0444, dev->debugfs, dev, &rotary_stats_fops);
+    debugfs_create_file("latency_hist", 0444, dev->debugfs, dev, &rotary_lat_hist_fops);
+}
+
+static int rotary_input_register(struct rotary_dev *dev) {
+    struct input_dev *in;
+    int ret;
+
+    in = devm_input_allocate_device(dev->parent);
+    if (!in)
+        return -ENOMEM;
+
+    in->name = "Rotary Encoder";
+    in->phys = devm_kasprintf(dev->parent, GFP_KERNEL, DRIVER_NAME "/input%d", dev->id);
+    in->id.bustype = BUS_HOST;
+    input_set_capability(in, EV_REL, REL_DIAL);
+    if (dev->line[ROTARY_SW].gpio)
+        input_set_capability(in, EV_KEY, KEY_ENTER);
+
+    ret = input_register_device(in);
+    if (ret)
+        return ret;
+
+    dev->input = in;
+    return 0;
+}
+
+/* 라인 하나의 IRQ: hard 핸들러는 시각만, GPIO 읽기는 스레드 (양쪽 엣지) */
+static int rotary_request_line(struct rotary_dev *dev, int idx, irq_handler_t thread_fn, const char *name) {
+    struct rotary_line *line = &dev->line[idx];
+
+    line->dev = dev;
+    line->irq = gpiod_to_irq(line->gpio);
+    if (line->irq < 0)
+        return line->irq;
+
+    return devm_request_threaded_irq(dev->parent, line->irq, rotary_irq_stamp, thread_fn,
+                                     IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING | IRQF_ONESHOT,
+                                     devm_kasprintf(dev->parent, GFP_KERNEL, "%s%d", name, dev->id),
+                                     line);
+}
+
+/* probe가 가진 참조: devres 맨 마지막에 풀리도록 가장 먼저 등록 */
+static void rotary_put_action(void *data) {
+    rotary_dev_put(data);
+}
+
+/* IRQ 요청보다 먼저 등록 -> IRQ가 풀린 뒤 실행되어 다시 걸릴 일이 없음 */
+static void rotary_timer_action(void *data) {
+    struct rotary_dev *dev = data;
+
+    hrtimer_cancel(&dev->sw_timer);
+}
+
+static int rotary_probe(struct platform_device *pdev) {
+    struct device *parent = &pdev->dev;
+    struct rotary_dev *dev;
+    struct device *cdev_dev;
+    unsigned long flags;
+    int ret;
+
+    /* devm 아님: 열린 파일이 unbind 뒤에도 dev를 잡고 있음 */
+    dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+    if (!dev)
+        return -ENOMEM;
+    kref_init(&dev->ref);
+    ret = devm_add_action_or_reset(parent, rotary_put_action, dev);
+    if (ret)
+        return ret;
+
+    dev->parent = parent;
+    dev->button = 1;
+    dev->state = R_START;
+    spin_lock_init(&dev->lock);
+    mutex_init(&dev->state_lock);
+    spin_lock_init(&dev->sw_lock);
+    INIT_LIST_HEAD(&dev->clients);
+    init_waitqueue_head(&dev->wait);
+    hrtimer_init(&dev->sw_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev->sw_timer.function = rotary_sw_settled;
+    ret = devm_add_action_or_reset(parent, rotary_timer_action, dev);
+    if (ret)
+        return ret;
+
+    /* DT: s1-gpios, s2-gpios, sw-gpios (선택), 모두 GPIO_ACTIVE_HIGH */
+    dev->line[ROTARY_S1].gpio = devm_gpiod_get(parent, "s1", GPIOD_IN);
+    if (IS_ERR(dev->line[ROTARY_S1].gpio))
+        return dev_err_probe(parent, PTR_ERR(dev->line[ROTARY_S1].gpio), "no s1 gpio\n");
+
+    dev->line[ROTARY_S2].gpio = devm_gpiod_get(parent, "s2", GPIOD_IN);
+    if (IS_ERR(dev->line[ROTARY_S2].gpio))
+        return dev_err_probe(parent, PTR_ERR(dev->line[ROTARY_S2].gpio), "no s2 gpio\n");
+
+    dev->line[ROTARY_SW].gpio = devm_gpiod_get_optional(parent, "sw", GPIOD_IN);
+    if (IS_ERR(dev->line[ROTARY_SW].gpio))
+        return dev_err_probe(parent, PTR_ERR(dev->line[ROTARY_SW].gpio), "bad sw gpio\n");
+
+    /* minor 예약만: open()은 probe가 끝난 뒤에야 dev를 찾음 */
+    mutex_lock(&rotary_idr_lock);
+    dev->id = idr_alloc(&rotary_idr, NULL, 0, ROTARY_MAX_DEVICES, GFP_KERNEL);
+    mutex_unlock(&rotary_idr_lock);
+    if (dev->id < 0)
+        return dev->id;
+
+    ret = rotary_request_line(dev, ROTARY_S1, rotary_int_handler, "rot_irq_s1_");
+    if (!ret)
+        ret = rotary_request_line(dev, ROTARY_S2, rotary_int_handler, "rot_irq_s2_");
+    if (!ret && dev->line[ROTARY_SW].gpio)
+        ret = rotary_request_line(dev, ROTARY_SW, rotary_sw_handler, "rot_irq_sw_");
+    if (ret) {
+        dev_err(parent, "irq request failed: %d\n", ret);
+        goto err_free_id;
+    }
+
+    if (input_events && rotary_input_register(dev))
+        dev_warn(parent, "input device registration failed\n");
+
+    /* char device: 첫 인코더는 기존 노드 이름 유지 */
+    dev->dev_num = MKDEV(MAJOR(rotary_devt), dev->id);
+    dev->cdev = cdev_alloc();
+    if (!dev->cdev) {
+        ret = -ENOMEM;
+        goto err_free_id;
+    }
+    dev->cdev->owner = THIS_MODULE;
+    dev->cdev->ops = &fops;
+    ret = cdev_add(dev->cdev, dev->dev_num, 1);
+    if (ret)
+        goto err_del_cdev;
+
+    if (dev->id)
+        cdev_dev = device_create(rotary_class, parent, dev->dev_num, dev,
+                                 "%s%d", DRIVER_NAME, dev->id);
+    else
+        cdev_dev = device_create(rotary_class, parent, dev->dev_num, dev,
+                                 DRIVER_NAME);
+    if (IS_ERR(cdev_dev)) {
+        ret = PTR_ERR(cdev_dev);
+        goto err_del_cdev;
+    }
+
+    rotary_debugfs_init(dev);
+
+    platform_set_drvdata(pdev, dev);
+
+    mutex_lock(&rotary_idr_lock);
+    idr_replace(&rotary_idr, dev, dev->id);
+    mutex_unlock(&rotary_idr_lock);
+
+    dev_info(parent, "rotary #%d ready\n", dev->id);
+    return 0;
+
+err_del_cdev:
+    cdev_del(dev->cdev);
+err_free_id:
+    mutex_lock(&rotary_idr_lock);
+    idr_remove(&rotary_idr, dev->id);
+    mutex_unlock(&rotary_idr_lock);
+    /* IRQ는 devres에서 풀리므로 그 전에 먼저 풀리는 input을 떼어 둠 */
+    spin_lock_irqsave(&dev->lock, flags);
+    dev->input = NULL;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    return ret;
+}
+
+/*
+ * 열린 파일은 dev 참조를 쥐고 있으므로 여기서는 연결만 끊음:
+ * dead를 세우고 깨우면 reader는 남은 이벤트를 읽은 뒤 ENODEV.
+ */
+static int rotary_remove(struct platform_device *pdev) {
+    struct rotary_dev *dev = platform_get_drvdata(pdev);
+    unsigned long flags;
+    int i;
+
+    mutex_lock(&rotary_idr_lock);
+    idr_remove(&rotary_idr, dev->id);
+    mutex_unlock(&rotary_idr_lock);
+
+    debugfs_remove_recursive(dev->debugfs);
+    device_destroy(rotary_class, dev->dev_num);
+    cdev_del(dev->cdev);
+
+    /* devm IRQ는 remove 뒤에 풀리므로 타이머를 다시 걸지 못하게 먼저 막음 */
+    for (i = 0; i < ROTARY_NR_LINES; i++)
+        if (dev->line[i].gpio)
+            disable_irq(dev->line[i].irq);
+    hrtimer_cancel(&dev->sw_timer);
+
+    spin_lock_irqsave(&dev->lock, flags);
+    dev->dead = true;
+    dev->input = NULL; // devm으로 곧 해제됨
+    spin_unlock_irqrestore(&dev->lock, flags);
+    wake_up_interruptible_all(&dev->wait);
+
+    return 0;
+}
+
+static const struct of_device_id rotary_of_match[] = {
+    { .compatible = "rotary-knob" },
+    { }
+};
+MODULE_DEVICE_TABLE(of, rotary_of_match);
+
+static struct platform_driver rotary_driver = {
+    .driver = {
+        .name = DRIVER_NAME,
+        .of_match_table = rotary_of_match,
+    },
+    .probe  = rotary_probe,
+    .remove = rotary_remove,
 };
 
+/* ================= Legacy (DT 없는 보드) ================= */
+
+static struct gpiod_lookup_table *rotary_lookup;
+static struct platform_device *rotary_legacy_pdev;
+
+/* 번호 -> (칩 라벨, 오프셋). gpio_chip이 없으면 전역 GPIO 번호로 봄 */
+static int rotary_lookup_set(struct gpiod_lookup *l, int num, const char *con_id) {
+    struct gpio_desc *desc;
+    struct gpio_chip *gc;
+
+    if (gpio_chip) {
+        *l = GPIO_LOOKUP(gpio_chip, num, con_id, GPIO_ACTIVE_HIGH);
+        return 0;
+    }
+
+    desc = gpio_to_desc(num);
+    if (!desc)
+        return -ENODEV;
+    gc = gpiod_to_chip(desc);
+    *l = GPIO_LOOKUP(gc->label, desc_to_gpio(desc) - gc->base,
+                     con_id, GPIO_ACTIVE_HIGH);
+    return 0;
+}
+
+static int __init rotary_legacy_register(void) {
+    int ret;
+
+    rotary_lookup = kzalloc(struct_size(rotary_lookup, table, ROTARY_NR_LINES + 1), GFP_KERNEL);
+    if (!rotary_lookup)
+        return -ENOMEM;
+
+    rotary_lookup->dev_id = DRIVER_NAME;
+    ret = rotary_lookup_set(&rotary_lookup->table[ROTARY_S1], s1_gpio, "s1");
+    if (!ret)
+        ret = rotary_lookup_set(&rotary_lookup->table[ROTARY_S2], s2_gpio, "s2");
+    if (!ret && sw_gpio >= 0)
+        ret = rotary_lookup_set(&rotary_lookup->table[ROTARY_SW], sw_gpio, "sw");
+    if (ret)
+        goto err_free;
+
+    gpiod_add_lookup_table(rotary_lookup);
+
+    rotary_legacy_pdev = platform_device_register_simple(DRIVER_NAME, PLATFORM_DEVID_NONE, NULL, 0);
+    if (IS_ERR(rotary_legacy_pdev)) {
+        ret = PTR_ERR(rotary_legacy_pdev);
+        rotary_legacy_pdev = NULL;
+        gpiod_remove_lookup_table(rotary_lookup);
+        goto err_free;
+    }
+    return 0;
+
+err_free:
+    kfree(rotary_lookup);
+    rotary_lookup = NULL;
+    return ret;
+}
+
+static void rotary_legacy_unregister(void) {
+    if (rotary_legacy_pdev)
+        platform_device_unregister(rotary_legacy_pdev);
+    if (rotary_lookup) {
+        gpiod_remove_lookup_table(rotary_lookup);
+        kfree(rotary_lookup);
+    }
+}
+
+/* ================= Module ================= */
+
 static int __init rotary_init(void) {
-    alloc_chrdev_region(&device_number, 0, 1, DRIVER_NAME);
-    cdev_init(&rotary_cdev, &fops);
-    cdev_add(&rotary_cdev, device_number, 1);
+    int ret;
+
+    ret = alloc_chrdev_region(&rotary_devt, 0, ROTARY_MAX_DEVICES, DRIVER_NAME);
+    if (ret)
+        return ret;
+
     rotary_class = class_create(THIS_MODULE, DRIVER_NAME);
-    device_create(rotary_class, NULL, device_number, NULL, DRIVER_NAME);
+    if (IS_ERR(rotary_class)) {
+        ret = PTR_ERR(rotary_class);
+        goto err_region;
+    }
 
-    gpio_request(S1_GPIO, "s1"); gpio_direction_input(S1_GPIO);
-    gpio_request(S2_GPIO, "s2"); gpio_direction_input(S2_GPIO);
-    gpio_request(SW_GPIO, "sw"); gpio_direction_input(SW_GPIO);
+    rotary_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
 
-    interrupt_num_s1 = gpio_to_irq(S1_GPIO);
-    request_irq(interrupt_num_s1, rotary_int_handler, IRQF_TRIGGER_FALLING, "rot_irq_s1", NULL);
+    /* 드라이버보다 먼저 등록: DT 인코더가 없으면 기존 배선이 #0 (/dev/rotary_device_driver) */
+    if (legacy) {
+        ret = rotary_legacy_register();
+        if (ret)
+            pr_warn("rotary: legacy encoder not created: %d\n", ret);
+    }
 
-    interrupt_num_sw = gpio_to_irq(SW_GPIO);
-    // [핵심 수정] RISING과 FALLING을 모두 감지하여 누름/뗌 체크 가능하게 함
-    request_irq(interrupt_num_sw, rotary_sw_handler, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, "rot_irq_sw", NULL);
+    ret = platform_driver_register(&rotary_driver);
+    if (ret)
+        goto err_legacy;
 
     return 0;
+
+err_legacy:
+    rotary_legacy_unregister();
+    debugfs_remove_recursive(rotary_debugfs_root);
+    class_destroy(rotary_class);
+err_region:
+    unregister_chrdev_region(rotary_devt, ROTARY_MAX_DEVICES);
+    return ret;
 }
 
 static void __exit rotary_exit(void) {
-    free_irq(interrupt_num_s1, NULL); free_irq(interrupt_num_sw, NULL);
-    gpio_free(S1_GPIO); gpio_free(S2_GPIO); gpio_free(SW_GPIO);
-    device_destroy(rotary_class, device_number); class_destroy(rotary_class);
-    cdev_del(&rotary_cdev); unregister_chrdev_region(device_number, 1);
+    platform_driver_unregister(&rotary_driver);
+    rotary_legacy_unregister();
+    debugfs_remove_recursive(rotary_debugfs_root);
+    class_destroy(rotary_class);
+    unregister_chrdev_region(rotary_devt, ROTARY_MAX_DEVICES);
+    idr_destroy(&rotary_idr);
 }
 
 module_init(rotary_init); module_exit(rotary_exit);
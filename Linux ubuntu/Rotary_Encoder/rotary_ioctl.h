@@ -0,0 +1,42 @@
+/*
+ * rotary_ioctl.h - userspace interface of /dev/rotary_device_driver
+ *
+ * Shared by the kernel module and applications (main1.c).
+ */
+#ifndef ROTARY_IOCTL_H
+#define ROTARY_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Read formats, per open file:
+ *   ROTARY_FMT_TEXT   (default) one "<value> <button> <timestamp_ns>\n"
+ *                     line per event, for cat / shell debugging
+ *   ROTARY_FMT_BINARY one struct rotary_record per event; a read of
+ *                     N * sizeof(struct rotary_record) bytes returns up
+ *                     to N queued records
+ */
+#define ROTARY_FMT_TEXT    0
+#define ROTARY_FMT_BINARY  1
+
+#define ROTARY_REC_ROTATE  0
+#define ROTARY_REC_BUTTON  1
+
+struct rotary_record {
+    __u64 timestamp_ns;  /* CLOCK_MONOTONIC time of the IRQ */
+    __s32 value;         /* cumulative count after this event */
+    __s32 delta;         /* value change since the previous record read
+                            on this file (covers overflowed events) */
+    __u8  type;          /* ROTARY_REC_* */
+    __u8  button;        /* 1 = released, 0 = pressed */
+    __u16 reserved;
+    __u32 dropped;       /* events lost to queue overflow on this file */
+};
+
+#define ROTARY_IOC_MAGIC       'R'
+
+/* Select the read format (__u32 ROTARY_FMT_*) */
+#define ROTARY_IOC_SET_FORMAT  _IOW(ROTARY_IOC_MAGIC, 0, __u32)
+
+#endif /* ROTARY_IOCTL_H */
@@ -4,71 +4,222 @@
 #include <linux/cdev.h>
 #include <linux/uaccess.h>
 #include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/gpio/driver.h>
+#include <linux/gpio/machine.h>
+#include <linux/bitmap.h>
 #include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/kernel.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/time.h>
+#include <linux/math64.h>
+#include <linux/hrtimer.h>
+#include <linux/bcd.h>
+#include <linux/rtc.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+
+#include "ds1302_ioctl.h"
 
 #define DRIVER_NAME "ds1302_driver"
 #define CLASS_NAME  "rtc_class"
 
-/* 핀 설정 (GPIO 17, 27, 22) */
-#define DS1302_CLK  17
-#define DS1302_DAT  27
-#define DS1302_RST  22
+/*
+ * 핀 설정 (기본 GPIO 17, 27, 22). gpio-sim 등에서는 그 칩 라인의 전역 번호.
+ * 번호는 lookup table을 만드는 데만 쓰고 디스크립터는 gpiod_get으로 받음
+ */
+static int clk_gpio = 17;
+module_param(clk_gpio, int, 0444);
+MODULE_PARM_DESC(clk_gpio, "SCLK line");
+
+static int dat_gpio = 27;
+module_param(dat_gpio, int, 0444);
+MODULE_PARM_DESC(dat_gpio, "I/O line");
+
+static int rst_gpio = 22;
+module_param(rst_gpio, int, 0444);
+MODULE_PARM_DESC(rst_gpio, "CE (RST) line");
+
+/* 목표 클럭: 반주기를 여기서 계산 (2V 보장값 500kHz, 5V면 2000까지) */
+static unsigned int clk_khz = 500;
+module_param(clk_khz, uint, 0644);
+MODULE_PARM_DESC(clk_khz, "Bit-bang clock rate in kHz (1..2000)");
+
+#define DS1302_BENCH_ROUNDS 16
+
+static struct gpio_desc *ds1302_clk, *ds1302_dat, *ds1302_rst;
+static struct gpio_desc *clk_dat[2]; // 배열 연산용 {CLK, DAT}
 
 /* DS1302 명령 코드 */
 #define CMD_READ_BURST   0xBF
 #define CMD_WRITE_BURST  0xBE
 #define CMD_WRITE_WP     0x8E // Write Protect
+#define CMD_RAM_READ_BURST   0xFF
+#define CMD_RAM_WRITE_BURST  0xFE
 
 static dev_t dev_num;
 static struct cdev my_cdev;
 static struct class *my_class;
 
-/* BCD 변환 헬퍼 함수 */
-static uint8_t bcd2bin(uint8_t val) { return ((val >> 4) * 10) + (val & 0x0F); }
-static uint8_t bin2bcd(uint8_t val) { return ((val / 10) << 4) + (val % 10); }
+/*
+ * 시간 캐시: 칩을 한 번 읽어 ktime_get()에 고정(anchor)해 두고,
+ * 이후 읽기는 경과 시간으로 외삽. resync_sec마다 / 쓰기 때만 칩을 다시 읽음.
+ */
+static unsigned int resync_sec = 60;
+module_param(resync_sec, uint, 0644);
+MODULE_PARM_DESC(resync_sec, "Re-read the chip after this many seconds (0 = on every read)");
+
+/*
+ * 락 두 개: bus_lock은 GPIO 트랜잭션 하나 (CE 올림 ~ 내림),
+ * ds1302_lock은 아래 캐시 상태. 둘 다 잡을 때는 bus_lock 먼저.
+ */
+static DEFINE_MUTEX(bus_lock);
+static DEFINE_MUTEX(ds1302_lock);
+static bool cache_valid;
+static time64_t anchor_secs;      // 칩 시각 (초)
+static ktime_t anchor_kt;         // anchor_secs 초가 시작된 것으로 보는 ktime
+static ktime_t last_sync;         // 마지막으로 칩을 읽은 ktime
+static uint8_t anchor_wday;       // 요일 레지스터 (1~7, 사용자 정의)
+static uint8_t chip_regs[8];      // 마지막으로 칩에서 읽은 값 (CH일 때 그대로 돌려줌)
+static ktime_t last_write;        // 이보다 먼저 시작된 burst 결과는 버림
+
+/*
+ * 시간 burst 공유: 진행 중인 burst가 있으면 새로 읽지 않고 그 결과를 씀.
+ * burst_started != burst_done 이면 진행 중 (한 번에 하나만).
+ */
+static DEFINE_SPINLOCK(burst_lock);
+static unsigned long burst_started, burst_done;
+static uint8_t burst_regs[8];
+static ktime_t burst_kt;          // burst를 시작한 시각 (칩이 시간을 래치한 순간)
+static DECLARE_WAIT_QUEUE_HEAD(burst_wq);
+static unsigned long bursts, coalesced; // 통계 (burst_lock)
+
+/*
+ * RTC class (/dev/rtcN): 칩에 알람 핀이 없으므로 알람은 anchor 기준의
+ * hrtimer로 흉내냄. RTC_UIE_ON(매초 갱신 이벤트)도 코어가 이 알람을
+ * 1초씩 다시 거는 방식이라 그대로 동작.
+ */
+static struct rtc_device *ds1302_rtc;
+static struct platform_device *ds1302_pdev;
+static struct hrtimer alarm_timer;
+static time64_t alarm_secs;
+static bool alarm_enabled;
+
+/*
+ * 초 경계 알림: poll()/read가 기다리는 동안 다음 초 경계(anchor 기준)에
+ * hrtimer를 걸어 깨움. 버스는 건드리지 않음.
+ */
+static struct hrtimer tick_timer;
+static DECLARE_WAIT_QUEUE_HEAD(tick_wq);
+static unsigned long tick_seq;    // 깨울 때마다 증가
+
+/* open()마다: 마지막으로 read가 돌려준 초 */
+struct ds1302_file {
+    time64_t seen;
+};
+
+/* BCD 변환은 <linux/bcd.h>의 bcd2bin / bin2bcd (rtc.h와 이름이 겹침) */
 
 /* ---- Low Level Bit-Banging 함수들 ---- */
 
-/* 1바이트 전송 (LSB부터) */
+/*
+ * 반주기(ns): DS1302 최대 클럭은 2V에서 500kHz, 5V에서 2MHz.
+ * 트랜잭션 시작 때 한 번 계산 (bus_lock 아래)
+ */
+static unsigned int half_ns;
+
+/*
+ * CLK/DAT을 한 번의 배열 연산으로: CLK 하강과 다음 비트 출력을 같이.
+ * 칩은 상승 엣지에서 래치하므로 반주기 뒤 상승 전까지 셋업 시간이 충분.
+ * gpio-sim처럼 sleep하는 칩도 있어 _cansleep (항상 프로세스 컨텍스트).
+ */
+static void ds1302_clk_dat(int clk, int dat)
+{
+    DECLARE_BITMAP(values, 2);
+
+    values[0] = (clk ? BIT(0) : 0) | (dat ? BIT(1) : 0);
+    gpiod_set_array_value_cansleep(2, clk_dat, NULL, values);
+}
+
+/*
+ * 반주기 대기. 기본 클럭(500kHz = 1us)처럼 us 이하 구간은 잠들 수 없어
+ * ndelay로 돌 수밖에 없고, 느린 클럭에서 10us를 넘으면 fsleep으로 잠듦.
+ * DS1302는 정적 로직이라 반주기가 길어지는 것은 상관없음.
+ */
+static void ds1302_half_delay(void)
+{
+    if (half_ns >= 10 * NSEC_PER_USEC)
+        fsleep(half_ns / NSEC_PER_USEC);
+    else
+        ndelay(half_ns);
+}
+
+/* CE 올림: 이때 CLK는 0이어야 함 (tCC 4us @2V). 최소값만 있어 잠들어도 됨 */
+static void ds1302_start(void)
+{
+    half_ns = 500000 / clamp(READ_ONCE(clk_khz), 1U, 2000U);
+
+    gpiod_set_value_cansleep(ds1302_clk, 0);
+    gpiod_set_value_cansleep(ds1302_rst, 1);
+    usleep_range(4, 10);
+}
+
+/* CE 내림 뒤 tCWH 4us @2V: 다음 트랜잭션까지 잠들며 기다림 */
+static void ds1302_stop(void)
+{
+    gpiod_set_value_cansleep(ds1302_clk, 0);
+    ds1302_half_delay();
+    gpiod_set_value_cansleep(ds1302_rst, 0);
+    usleep_range(4, 10);
+}
+
+/*
+ * 1바이트 전송 (LSB부터). 비트마다 GPIO 연산 2번:
+ * [CLK=0, DAT=bit] -> 반주기 -> CLK=1 -> 반주기. 끝나면 CLK=1.
+ */
 static void ds1302_write_byte(uint8_t dat)
 {
     int i;
 
-    gpio_direction_output(DS1302_DAT, 0);
+    gpiod_direction_output(ds1302_dat, dat & 0x01);
 
     for (i = 0; i < 8; i++) {
-        gpio_set_value(DS1302_DAT, dat & 0x01);
-        udelay(2);
-
-        gpio_set_value(DS1302_CLK, 1);
-        udelay(2);
+        ds1302_clk_dat(0, dat & 0x01);
+        ds1302_half_delay();
 
-        gpio_set_value(DS1302_CLK, 0);
-        udelay(2);
+        gpiod_set_value_cansleep(ds1302_clk, 1);
+        ds1302_half_delay();
 
         dat >>= 1;
     }
 }
 
-/* 1바이트 수신 (LSB부터) - ✅ 정석 구현 */
+/*
+ * 1바이트 수신 (LSB부터). 칩은 CLK 하강 엣지에서 다음 비트를 내보내므로
+ * 하강 -> 반주기(tCDD) -> 샘플 -> 상승. 쓰기와 같이 CLK=1로 끝남.
+ */
 static uint8_t ds1302_read_byte(void)
 {
     int i;
     uint8_t dat = 0;
 
-    gpio_direction_input(DS1302_DAT);
+    gpiod_direction_input(ds1302_dat);
 
     for (i = 0; i < 8; i++) {
+        gpiod_set_value_cansleep(ds1302_clk, 0);
+        ds1302_half_delay();
+
         /* DS1302는 LSB-first: i번째 비트를 그대로 채움 */
-        if (gpio_get_value(DS1302_DAT))
+        if (gpiod_get_value_cansleep(ds1302_dat))
             dat |= (1 << i);
 
-        gpio_set_value(DS1302_CLK, 1);
-        udelay(2);
-        gpio_set_value(DS1302_CLK, 0);
-        udelay(2);
+        gpiod_set_value_cansleep(ds1302_clk, 1);
+        ds1302_half_delay();
     }
 
     return dat;
@@ -79,16 +230,47 @@ static void ds1302_read_time(uint8_t *buf)
 {
     int i;
 
-    gpio_set_value(DS1302_RST, 1);
-    udelay(4);
+    ds1302_start();
 
     ds1302_write_byte(CMD_READ_BURST);
 
     for (i = 0; i < 7; i++)
         buf[i] = ds1302_read_byte();
 
-    gpio_set_value(DS1302_RST, 0);
-    udelay(4);
+    ds1302_stop();
+}
+
+static void ds1302_wp_off(void)
+{
+    ds1302_start();
+    ds1302_write_byte(CMD_WRITE_WP);
+    ds1302_write_byte(0x00);
+    ds1302_stop();
+}
+
+/* RAM 31바이트 burst 읽기 / 쓰기 */
+static void ds1302_read_ram(uint8_t *buf)
+{
+    int i;
+
+    ds1302_start();
+    ds1302_write_byte(CMD_RAM_READ_BURST);
+    for (i = 0; i < DS1302_RAM_SIZE; i++)
+        buf[i] = ds1302_read_byte();
+    ds1302_stop();
+}
+
+static void ds1302_write_ram(const uint8_t *buf)
+{
+    int i;
+
+    ds1302_wp_off();
+
+    ds1302_start();
+    ds1302_write_byte(CMD_RAM_WRITE_BURST);
+    for (i = 0; i < DS1302_RAM_SIZE; i++)
+        ds1302_write_byte(buf[i]);
+    ds1302_stop();
 }
 
 /* 시간 쓰기 함수 */
@@ -100,38 +282,371 @@ static void ds1302_set_time(uint8_t *buf)
     buf[0] &= 0x7F;
 
     /* 1) Write Protect Off */
-    gpio_set_value(DS1302_RST, 1);
-    udelay(4);
-    ds1302_write_byte(CMD_WRITE_WP);
-    ds1302_write_byte(0x00);
-    gpio_set_value(DS1302_RST, 0);
-    udelay(4);
+    ds1302_wp_off();
 
     /* 2) Burst write */
-    gpio_set_value(DS1302_RST, 1);
-    udelay(4);
+    ds1302_start();
     ds1302_write_byte(CMD_WRITE_BURST);
     for (i = 0; i < 7; i++)
         ds1302_write_byte(buf[i]);
 
     ds1302_write_byte(0x00); // WP reg
-    gpio_set_value(DS1302_RST, 0);
-    udelay(4);
+    ds1302_stop();
+}
+
+/* ---- 캐시 / 외삽 ---- */
+
+static enum hrtimer_restart ds1302_alarm_fire(struct hrtimer *t)
+{
+    struct rtc_device *rtc = READ_ONCE(ds1302_rtc);
+
+    if (rtc)
+        rtc_update_irq(rtc, 1, RTC_AF | RTC_IRQF);
+    return HRTIMER_NORESTART;
+}
+
+static enum hrtimer_restart ds1302_tick_fire(struct hrtimer *t)
+{
+    WRITE_ONCE(tick_seq, tick_seq + 1);
+    wake_up_interruptible(&tick_wq);
+    return HRTIMER_NORESTART;
+}
+
+/* secs 다음 초가 시작되는 순간에 깨움 (ds1302_lock 아래) */
+static void ds1302_tick_arm(time64_t secs)
+{
+    if (cache_valid)
+        hrtimer_start(&tick_timer, anchor_kt + (secs - anchor_secs + 1) * NSEC_PER_SEC,
+                      HRTIMER_MODE_ABS);
+    else // 발진 정지: 초가 바뀌지 않으므로 1초마다 다시 확인만
+        hrtimer_start(&tick_timer, ktime_add_ms(ktime_get(), MSEC_PER_SEC),
+                      HRTIMER_MODE_ABS);
+}
+
+/* anchor가 바뀔 때마다 다시 계산 (ds1302_lock 아래) */
+static void ds1302_alarm_arm(void)
+{
+    if (!alarm_enabled || !cache_valid) {
+        hrtimer_cancel(&alarm_timer);
+        return;
+    }
+    hrtimer_start(&alarm_timer, anchor_kt + (alarm_secs - anchor_secs) * NSEC_PER_SEC,
+                  HRTIMER_MODE_ABS);
+}
+
+static time64_t ds1302_regs_to_secs(const uint8_t *reg)
+{
+    return mktime64(2000 + bcd2bin(reg[6]), bcd2bin(reg[4]), bcd2bin(reg[3]),
+                    bcd2bin(reg[2]), bcd2bin(reg[1]), bcd2bin(reg[0] & 0x7F));
+}
+
+/* anchor로 외삽한 now 시점의 초 (cache_valid일 때만, ds1302_lock 아래) */
+static time64_t ds1302_now_secs(ktime_t now)
+{
+    return anchor_secs + div_s64(ktime_to_ns(ktime_sub(now, anchor_kt)), NSEC_PER_SEC);
+}
+
+/*
+ * anchor가 바뀐 뒤 걸려 있는 초 경계 타이머를 새 위상으로 옮김.
+ * 보이는 초가 바뀌었으면 바로 깨우고, 아니면 새 anchor의 다음 경계로.
+ * (매번 깨우면 resync_sec=0에서 poll -> resync -> 깨움이 맴돎) ds1302_lock 아래
+ */
+static void ds1302_tick_rearm(bool was_valid, time64_t old_secs)
+{
+    time64_t secs;
+
+    if (!hrtimer_is_queued(&tick_timer))
+        return;
+
+    if (!cache_valid) {
+        ds1302_tick_arm(0);
+        return;
+    }
+
+    secs = ds1302_now_secs(ktime_get());
+    if (was_valid && secs == old_secs)
+        ds1302_tick_arm(secs);
+    else
+        hrtimer_start(&tick_timer, ktime_get(), HRTIMER_MODE_ABS);
+}
+
+/*
+ * 시간 burst read, 동시에 온 reader끼리 공유. 진행 중인 burst가 있으면
+ * 끝나기를 기다렸다가 그 결과를 받음 -> reader가 몇이든 버스는 한 번.
+ * 반환값은 그 burst를 시작한 시각.
+ */
+static ktime_t ds1302_read_time_shared(uint8_t *reg)
+{
+    unsigned long seq;
+    ktime_t kt;
+
+    spin_lock(&burst_lock);
+    if (burst_started != burst_done) {
+        seq = burst_started;
+        coalesced++;
+        spin_unlock(&burst_lock);
+
+        wait_event(burst_wq, (long)(READ_ONCE(burst_done) - seq) >= 0);
+
+        spin_lock(&burst_lock);
+        memcpy(reg, burst_regs, 7);
+        kt = burst_kt;
+        spin_unlock(&burst_lock);
+        return kt;
+    }
+    seq = ++burst_started;
+    bursts++;
+    spin_unlock(&burst_lock);
+
+    mutex_lock(&bus_lock);
+    kt = ktime_get();
+    ds1302_read_time(reg);
+    mutex_unlock(&bus_lock);
+
+    spin_lock(&burst_lock);
+    memcpy(burst_regs, reg, 7);
+    burst_kt = kt;
+    WRITE_ONCE(burst_done, seq);
+    spin_unlock(&burst_lock);
+    wake_up_all(&burst_wq);
+
+    return kt;
+}
+
+/*
+ * 첫 동기화용 읽기: 한 번 읽은 값만으로는 경계가 최대 1초까지 늦으므로
+ * 초 레지스터가 바뀔 때까지 1~2ms 간격으로 다시 읽음 (최대 1.1초).
+ * 바뀐 읽기의 시각은 진짜 경계보다 한 간격 이내로만 늦음.
+ * 기다리는 사이 다른 reader가 먼저 잡았으면 한 번만 읽고 끝냄.
+ * 반환값은 마지막 burst를 시작한 시각.
+ */
+static ktime_t ds1302_read_time_edge(uint8_t *reg)
+{
+    ktime_t kt, end;
+    uint8_t sec;
+    bool valid;
+
+    mutex_lock(&bus_lock);
+    mutex_lock(&ds1302_lock);
+    valid = cache_valid;
+    mutex_unlock(&ds1302_lock);
+
+    kt = ktime_get();
+    ds1302_read_time(reg);
+    sec = reg[0];
+    end = ktime_add_ms(kt, 1100);
+    while (!valid && !(sec & 0x80) && ktime_before(kt, end)) { // CH면 초가 안 바뀜
+        usleep_range(1000, 2000);
+        kt = ktime_get();
+        ds1302_read_time(reg);
+        if (reg[0] != sec)
+            break;
+    }
+    mutex_unlock(&bus_lock);
+
+    return kt;
+}
+
+/*
+ * 칩에서 읽은 값으로 anchor 위상 보정. 칩은 초 단위라 읽은 순간이 그 초의
+ * 어디쯤인지 모름: 진짜 경계 B는 (now - 1s, now] 안에 있음.
+ * 이전 anchor가 말하는 경계를 이 범위로 잘라서 씀 -> 칩이 앞서 있으면
+ * anchor를 당기고, 뒤처져 있으면 미룸. 읽을수록 경계가 좁혀짐.
+ * 순서가 뒤바뀐 결과가 와도 두 범위 모두 참이라 안전. ds1302_lock 아래
+ */
+static void ds1302_resync(ktime_t now, const uint8_t *reg)
+{
+    bool was_valid = cache_valid;
+    time64_t chip, old_secs = 0;
+    ktime_t b;
+
+    memcpy(chip_regs, reg, 7);
+    last_sync = max(last_sync, now);
+    if (was_valid)
+        old_secs = ds1302_now_secs(ktime_get());
+
+    if (reg[0] & 0x80) { // CH: 발진 정지 상태면 외삽 불가
+        cache_valid = false;
+        ds1302_alarm_arm();
+        ds1302_tick_rearm(was_valid, old_secs);
+        return;
+    }
+
+    chip = ds1302_regs_to_secs(reg);
+    b = now;
+    if (cache_valid) {
+        b = anchor_kt + (chip - anchor_secs) * NSEC_PER_SEC;
+        if (b > now)
+            b = now;
+        else if (b <= ktime_sub_ns(now, NSEC_PER_SEC))
+            b = ktime_sub_ns(now, NSEC_PER_SEC - 1);
+    }
+
+    anchor_secs = chip;
+    anchor_kt = b;
+    anchor_wday = bcd2bin(reg[5]);
+    cache_valid = true;
+    ds1302_alarm_arm();
+    ds1302_tick_rearm(was_valid, old_secs);
+}
+
+/* 필요하면 칩을 다시 읽어 anchor 갱신. 락 없이 호출 (버스 읽기는 공유) */
+static void ds1302_refresh(void)
+{
+    uint8_t reg[8];
+    ktime_t kt;
+    bool first, need;
+
+    mutex_lock(&ds1302_lock);
+    first = !cache_valid;
+    need = first || !resync_sec ||
+           ktime_ms_delta(ktime_get(), last_sync) >= (s64)resync_sec * MSEC_PER_SEC;
+    mutex_unlock(&ds1302_lock);
+    if (!need)
+        return;
+
+    /* 캐시가 없을 때는 경계를 직접 찾아 anchor가 처음부터 정확하도록 */
+    kt = first ? ds1302_read_time_edge(reg) : ds1302_read_time_shared(reg);
+
+    mutex_lock(&ds1302_lock);
+    if (kt >= last_write) // 쓰기 전에 시작된 burst면 옛 시간
+        ds1302_resync(kt, reg);
+    mutex_unlock(&ds1302_lock);
+}
+
+/*
+ * 현재 시각 레지스터 (BCD 7바이트): 버스 접근 없음 (먼저 ds1302_refresh).
+ * 반환값은 같은 시각의 초 (초가 바뀌었는지 비교용). ds1302_lock 아래
+ */
+static time64_t __ds1302_get_time(uint8_t *reg)
+{
+    ktime_t now;
+    time64_t secs;
+    struct tm tm;
+    s64 days;
+
+    if (!cache_valid) {
+        memcpy(reg, chip_regs, 7);
+        return ds1302_regs_to_secs(reg);
+    }
+
+    now = ktime_get();
+    secs = ds1302_now_secs(now);
+    time64_to_tm(secs, 0, &tm);
+    days = div_s64(secs, 86400) - div_s64(anchor_secs, 86400);
+
+    reg[0] = bin2bcd(tm.tm_sec);
+    reg[1] = bin2bcd(tm.tm_min);
+    reg[2] = bin2bcd(tm.tm_hour);
+    reg[3] = bin2bcd(tm.tm_mday);
+    reg[4] = bin2bcd(tm.tm_mon + 1);
+    reg[5] = bin2bcd((anchor_wday + 6 + days) % 7 + 1);
+    reg[6] = bin2bcd(tm.tm_year - 100);
+    return secs;
+}
+
+static void ds1302_get_time(uint8_t *reg)
+{
+    ds1302_refresh();
+
+    mutex_lock(&ds1302_lock);
+    __ds1302_get_time(reg);
+    mutex_unlock(&ds1302_lock);
+}
+
+/* 쓰기 후에는 쓴 값을 새 anchor로 (위상은 다음 resync에서 보정) */
+static void ds1302_put_time(uint8_t *reg)
+{
+    mutex_lock(&bus_lock);
+    ds1302_set_time(reg);
+
+    mutex_lock(&ds1302_lock);
+    anchor_secs = ds1302_regs_to_secs(reg);
+    anchor_kt = last_sync = last_write = ktime_get();
+    anchor_wday = bcd2bin(reg[5]);
+    memcpy(chip_regs, reg, 7);
+    cache_valid = true;
+    ds1302_alarm_arm();
+    ds1302_tick_rearm(false, 0);
+    mutex_unlock(&ds1302_lock);
+    mutex_unlock(&bus_lock);
+
+    /* 시각이 바뀌었으니 기다리던 쪽이 바로 다시 읽도록 */
+    WRITE_ONCE(tick_seq, tick_seq + 1);
+    wake_up_interruptible(&tick_wq);
 }
 
 /* ---- File Operations ---- */
 
-static int ds1302_open(struct inode *inode, struct file *file) { return 0; }
-static int ds1302_release(struct inode *inode, struct file *file) { return 0; }
+static int ds1302_open(struct inode *inode, struct file *file)
+{
+    struct ds1302_file *f = kzalloc(sizeof(*f), GFP_KERNEL);
+
+    if (!f)
+        return -ENOMEM;
+    f->seen = -1; // 처음 read는 바로 반환
+    file->private_data = f;
+    return 0;
+}
 
-/* cat /dev/ds1302_driver */
+static int ds1302_release(struct inode *inode, struct file *file)
+{
+    kfree(file->private_data);
+    return 0;
+}
+
+/* 이 파일이 아직 읽지 않은 초가 되면 POLLIN */
+static unsigned int ds1302_poll(struct file *file, poll_table *wait)
+{
+    struct ds1302_file *f = file->private_data;
+    uint8_t time_reg[8];
+    time64_t secs;
+
+    poll_wait(file, &tick_wq, wait);
+
+    ds1302_refresh();
+    mutex_lock(&ds1302_lock);
+    secs = __ds1302_get_time(time_reg);
+    if (secs == f->seen)
+        ds1302_tick_arm(secs);
+    mutex_unlock(&ds1302_lock);
+
+    return secs != f->seen ? POLLIN | POLLRDNORM : 0;
+}
+
+/*
+ * cat /dev/ds1302_driver
+ * 오프셋 0에서 읽을 때, 이 파일이 이미 본 초라면 다음 초까지 블록
+ * (O_NONBLOCK이면 -EAGAIN). cat은 처음 한 번만 오프셋 0이라 그대로 동작.
+ */
 static ssize_t ds1302_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
 {
+    struct ds1302_file *f = file->private_data;
     uint8_t time_reg[8] = {0};
     char msg[64];
+    unsigned long seq;
+    time64_t secs;
     int len;
 
-    ds1302_read_time(time_reg);
+    for (;;) {
+        ds1302_refresh();
+        mutex_lock(&ds1302_lock);
+        secs = __ds1302_get_time(time_reg);
+        if (*ppos || secs != f->seen)
+            break;
+        seq = READ_ONCE(tick_seq);
+        ds1302_tick_arm(secs);
+        mutex_unlock(&ds1302_lock);
+
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        if (wait_event_interruptible(tick_wq, READ_ONCE(tick_seq) != seq))
+            return -ERESTARTSYS;
+    }
+    mutex_unlock(&ds1302_lock);
+
+    if (!*ppos)
+        f->seen = secs;
 
     /* ✅ seconds에서 CH bit 제거 후 변환 */
     time_reg[0] &= 0x7F;
@@ -149,9 +664,36 @@ static ssize_t ds1302_read(struct file *file, char __user *buf, size_t count, lo
 }
 
 /* echo "24 12 25 13 00 00 3" > /dev/ds1302_driver */
+static bool ds1302_bcd_ok(uint8_t v) { return (v & 0x0F) < 10 && (v >> 4) < 10; }
+
+/*
+ * 24시간 모드 BCD 범위 확인 (12시간 모드는 지원 안 함).
+ * 날짜는 그 달의 일수까지: 2월 31일 같은 값은 칩에는 그대로 들어가지만
+ * mktime64()가 3월로 넘겨 캐시와 칩이 어긋남
+ */
+static bool ds1302_regs_valid(const struct ds1302_regs *r)
+{
+    unsigned int mon;
+
+    if (!ds1302_bcd_ok(r->sec & 0x7F) || !ds1302_bcd_ok(r->min) || !ds1302_bcd_ok(r->hour) ||
+        !ds1302_bcd_ok(r->mday) || !ds1302_bcd_ok(r->mon) || !ds1302_bcd_ok(r->wday) ||
+        !ds1302_bcd_ok(r->year))
+        return false;
+
+    mon = bcd2bin(r->mon);
+    if (mon < 1 || mon > 12)
+        return false;
+
+    return bcd2bin(r->sec & 0x7F) < 60 && bcd2bin(r->min) < 60 && bcd2bin(r->hour) < 24 &&
+           bcd2bin(r->mday) >= 1 &&
+           bcd2bin(r->mday) <= rtc_month_days(mon - 1, 2000 + bcd2bin(r->year)) &&
+           bcd2bin(r->wday) >= 1 && bcd2bin(r->wday) <= 7;
+}
+
 static ssize_t ds1302_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
 {
     char kbuf[64];
+    struct ds1302_regs regs = { };
     uint8_t time_reg[8];
     int year, month, day, hour, min, sec, wday;
 
@@ -165,66 +707,410 @@ static ssize_t ds1302_write(struct file *file, const char __user *buf, size_t co
         return -EINVAL;
     }
 
-    time_reg[0] = bin2bcd(sec) & 0x7F;   /* ✅ CH=0 보장 */
-    time_reg[1] = bin2bcd(min);
-    time_reg[2] = bin2bcd(hour);
-    time_reg[3] = bin2bcd(day);
-    time_reg[4] = bin2bcd(month);
-    time_reg[5] = bin2bcd(wday);
-    time_reg[6] = bin2bcd(year);
-    time_reg[7] = 0x00;
+    /* bin2bcd()는 0..99만 의미 있음, 나머지 범위는 SET_REGS와 같은 검사로 */
+    if (year < 0 || year > 99 || month < 0 || month > 99 || day < 0 || day > 99 ||
+        hour < 0 || hour > 99 || min < 0 || min > 99 || sec < 0 || sec > 99 ||
+        wday < 0 || wday > 99)
+        return -EINVAL;
 
-    ds1302_set_time(time_reg);
+    regs.sec  = bin2bcd(sec);
+    regs.min  = bin2bcd(min);
+    regs.hour = bin2bcd(hour);
+    regs.mday = bin2bcd(day);
+    regs.mon  = bin2bcd(month);
+    regs.wday = bin2bcd(wday);
+    regs.year = bin2bcd(year);
+    /* regs_valid()는 CH 비트를 보지 않으므로 80..99초가 정지 비트로 새지 않게 따로 막음 */
+    if (!ds1302_regs_valid(&regs) || (regs.sec & 0x80))
+        return -EINVAL;
+
+    memcpy(time_reg, &regs, 7);
+    time_reg[7] = 0x00;
+    ds1302_put_time(time_reg);
     return count;
 }
 
+static long ds1302_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    void __user *argp = (void __user *)arg;
+    struct ds1302_regs regs = { };
+    struct ds1302_ram ram = { };
+    uint8_t time_reg[8];
+
+    switch (cmd) {
+    case DS1302_IOC_GET_REGS:
+        ds1302_get_time(time_reg);
+        memcpy(&regs, time_reg, 7);
+        return copy_to_user(argp, &regs, sizeof(regs)) ? -EFAULT : 0;
+
+    case DS1302_IOC_SET_REGS:
+        if (copy_from_user(&regs, argp, sizeof(regs)))
+            return -EFAULT;
+        if (!ds1302_regs_valid(&regs))
+            return -EINVAL;
+        memcpy(time_reg, &regs, 7);
+        time_reg[7] = 0x00;
+        ds1302_put_time(time_reg);
+        return 0;
+
+    case DS1302_IOC_RAM_READ:
+        mutex_lock(&bus_lock);
+        ds1302_read_ram(ram.data);
+        mutex_unlock(&bus_lock);
+        return copy_to_user(argp, &ram, sizeof(ram)) ? -EFAULT : 0;
+
+    case DS1302_IOC_RAM_WRITE:
+        if (copy_from_user(&ram, argp, sizeof(ram)))
+            return -EFAULT;
+        mutex_lock(&bus_lock);
+        ds1302_write_ram(ram.data);
+        mutex_unlock(&bus_lock);
+        return 0;
+
+    default:
+        return -ENOTTY;
+    }
+}
+
 static struct file_operations fops = {
-    .owner   = THIS_MODULE,
-    .open    = ds1302_open,
-    .release = ds1302_release,
-    .read    = ds1302_read,
-    .write   = ds1302_write,
-    .llseek  = default_llseek,
+    .owner          = THIS_MODULE,
+    .open           = ds1302_open,
+    .release        = ds1302_release,
+    .read           = ds1302_read,
+    .write          = ds1302_write,
+    .poll           = ds1302_poll,
+    .llseek         = default_llseek,
+    .unlocked_ioctl = ds1302_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+};
+
+/* ---- sysfs: 버스 속도 측정 ---- */
+
+/*
+ * sudo cat /sys/class/rtc_class/ds1302_driver/bench
+ * 캐시를 거치지 않고 burst read를 DS1302_BENCH_ROUNDS번 돌려 트랜잭션 시간 측정
+ */
+static ssize_t bench_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    uint8_t reg[8];
+    u64 t, min_ns = U64_MAX, max_ns = 0, sum_ns = 0;
+    unsigned int khz;
+    int i;
+
+    mutex_lock(&bus_lock);
+    for (i = 0; i < DS1302_BENCH_ROUNDS; i++) {
+        t = ktime_get_ns();
+        ds1302_read_time(reg);
+        t = ktime_get_ns() - t;
+
+        min_ns = min(min_ns, t);
+        max_ns = max(max_ns, t);
+        sum_ns += t;
+    }
+    khz = 500000 / half_ns;
+    mutex_unlock(&bus_lock);
+
+    return sysfs_emit(buf, "clk_khz %u\nburst_read_ns avg %llu min %llu max %llu\n",
+                      khz, div_u64(sum_ns, DS1302_BENCH_ROUNDS), min_ns, max_ns);
+}
+static DEVICE_ATTR_ADMIN_RO(bench); // 0400: 버스를 오래 잡으므로 root만
+
+/* 시간 burst 횟수와, 진행 중인 burst를 공유해 버스를 안 쓴 읽기 횟수 */
+static ssize_t bus_stats_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    unsigned long b, c;
+
+    spin_lock(&burst_lock);
+    b = bursts;
+    c = coalesced;
+    spin_unlock(&burst_lock);
+
+    return sysfs_emit(buf, "bursts %lu\ncoalesced %lu\n", b, c);
+}
+static DEVICE_ATTR_RO(bus_stats);
+
+static struct attribute *ds1302_attrs[] = {
+    &dev_attr_bench.attr,
+    &dev_attr_bus_stats.attr,
+    NULL,
 };
+ATTRIBUTE_GROUPS(ds1302);
+
+/* ---- RTC class ---- */
+
+static int ds1302_rtc_read_time(struct device *dev, struct rtc_time *tm)
+{
+    uint8_t reg[8];
+
+    ds1302_get_time(reg);
+    if (reg[0] & 0x80) // CH: 발진 정지 = 시간 무효
+        return -EINVAL;
+
+    rtc_time64_to_tm(ds1302_regs_to_secs(reg), tm);
+    return 0;
+}
+
+static int ds1302_rtc_set_time(struct device *dev, struct rtc_time *tm)
+{
+    uint8_t reg[8];
+
+    reg[0] = bin2bcd(tm->tm_sec);
+    reg[1] = bin2bcd(tm->tm_min);
+    reg[2] = bin2bcd(tm->tm_hour);
+    reg[3] = bin2bcd(tm->tm_mday);
+    reg[4] = bin2bcd(tm->tm_mon + 1);
+    reg[5] = bin2bcd(tm->tm_wday + 1); // 1 = 일요일
+    reg[6] = bin2bcd(tm->tm_year - 100);
+    reg[7] = 0x00;
+
+    ds1302_put_time(reg);
+    return 0;
+}
+
+static int ds1302_rtc_read_alarm(struct device *dev, struct rtc_wkalrm *alrm)
+{
+    mutex_lock(&ds1302_lock);
+    rtc_time64_to_tm(alarm_secs, &alrm->time);
+    alrm->enabled = alarm_enabled;
+    mutex_unlock(&ds1302_lock);
+    return 0;
+}
+
+static int ds1302_rtc_set_alarm(struct device *dev, struct rtc_wkalrm *alrm)
+{
+    ds1302_refresh(); // anchor 확보
+
+    mutex_lock(&ds1302_lock);
+    alarm_secs = rtc_tm_to_time64(&alrm->time);
+    alarm_enabled = alrm->enabled;
+    ds1302_alarm_arm();
+    mutex_unlock(&ds1302_lock);
+    return 0;
+}
+
+static int ds1302_rtc_alarm_irq_enable(struct device *dev, unsigned int enabled)
+{
+    mutex_lock(&ds1302_lock);
+    alarm_enabled = enabled;
+    ds1302_alarm_arm();
+    mutex_unlock(&ds1302_lock);
+    return 0;
+}
+
+static const struct rtc_class_ops ds1302_rtc_ops = {
+    .read_time        = ds1302_rtc_read_time,
+    .set_time         = ds1302_rtc_set_time,
+    .read_alarm       = ds1302_rtc_read_alarm,
+    .set_alarm        = ds1302_rtc_set_alarm,
+    .alarm_irq_enable = ds1302_rtc_alarm_irq_enable,
+};
+
+static int ds1302_rtc_probe(struct platform_device *pdev)
+{
+    struct rtc_device *rtc;
+    int ret;
+
+    rtc = devm_rtc_allocate_device(&pdev->dev);
+    if (IS_ERR(rtc))
+        return PTR_ERR(rtc);
+
+    rtc->ops = &ds1302_rtc_ops;
+    rtc->range_min = RTC_TIMESTAMP_BEGIN_2000;
+    rtc->range_max = RTC_TIMESTAMP_END_2099;
+
+    ret = devm_rtc_register_device(rtc);
+    if (ret)
+        return ret;
+
+    /* 등록이 실패하면 devm이 rtc를 바로 풀어버리므로 성공한 뒤에만 공개 */
+    WRITE_ONCE(ds1302_rtc, rtc);
+    return 0;
+}
+
+/*
+ * devm rtc는 remove가 끝난 뒤 해제되므로 그 전에 끊어 둠: 이후 알람이
+ * 울려도 rtc_update_irq()를 부르지 않고, 실행 중인 콜백은 기다림.
+ */
+static int ds1302_rtc_remove(struct platform_device *pdev)
+{
+    WRITE_ONCE(ds1302_rtc, NULL);
+    hrtimer_cancel(&alarm_timer);
+    return 0;
+}
+
+static struct platform_driver ds1302_rtc_driver = {
+    .driver = { .name = DRIVER_NAME },
+    .probe  = ds1302_rtc_probe,
+    .remove = ds1302_rtc_remove,
+};
+
+/* 핀 번호 -> (칩 라벨, 오프셋): 디스크립터는 lookup table로 gpiod_get */
+static struct gpiod_lookup_table ds1302_lookup = {
+    .dev_id = DRIVER_NAME,
+    .table = { { }, { }, { }, { } },
+};
+
+static int __init ds1302_lookup_set(struct gpiod_lookup *l, int num, const char *con_id)
+{
+    struct gpio_desc *desc = gpio_to_desc(num);
+    struct gpio_chip *gc;
+
+    if (!desc)
+        return -ENODEV;
+    gc = gpiod_to_chip(desc);
+    *l = GPIO_LOOKUP(gc->label, desc_to_gpio(desc) - gc->base, con_id, GPIO_ACTIVE_HIGH);
+    return 0;
+}
+
+static void ds1302_gpio_put(void)
+{
+    if (ds1302_rst) {
+        gpiod_set_value_cansleep(ds1302_rst, 0);
+        gpiod_put(ds1302_rst);
+    }
+    if (ds1302_dat)
+        gpiod_put(ds1302_dat);
+    if (ds1302_clk)
+        gpiod_put(ds1302_clk);
+    ds1302_clk = ds1302_dat = ds1302_rst = NULL;
+}
+
+/* 플랫폼 디바이스가 핀을 소유. RTC 드라이버는 마지막에 붙음 */
+static int __init ds1302_gpio_get(struct device *dev)
+{
+    int ret;
+
+    ds1302_clk = gpiod_get(dev, "clk", GPIOD_OUT_LOW);
+    if (IS_ERR(ds1302_clk)) {
+        ret = PTR_ERR(ds1302_clk);
+        ds1302_clk = NULL;
+        goto err;
+    }
+    ds1302_dat = gpiod_get(dev, "dat", GPIOD_OUT_LOW);
+    if (IS_ERR(ds1302_dat)) {
+        ret = PTR_ERR(ds1302_dat);
+        ds1302_dat = NULL;
+        goto err;
+    }
+    ds1302_rst = gpiod_get(dev, "rst", GPIOD_OUT_LOW);
+    if (IS_ERR(ds1302_rst)) {
+        ret = PTR_ERR(ds1302_rst);
+        ds1302_rst = NULL;
+        goto err;
+    }
+
+    clk_dat[0] = ds1302_clk;
+    clk_dat[1] = ds1302_dat;
+    return 0;
+
+err:
+    ds1302_gpio_put();
+    return ret;
+}
 
 static int __init ds1302_init(void)
 {
-    if (gpio_request(DS1302_CLK, "ds1302_clk") ||
-        gpio_request(DS1302_DAT, "ds1302_dat") ||
-        gpio_request(DS1302_RST, "ds1302_rst")) {
+    struct device *node;
+    int ret;
+
+    ret = ds1302_lookup_set(&ds1302_lookup.table[0], clk_gpio, "clk");
+    if (!ret)
+        ret = ds1302_lookup_set(&ds1302_lookup.table[1], dat_gpio, "dat");
+    if (!ret)
+        ret = ds1302_lookup_set(&ds1302_lookup.table[2], rst_gpio, "rst");
+    if (ret) {
+        printk("DS1302: no GPIO %d/%d/%d\n", clk_gpio, dat_gpio, rst_gpio);
+        return ret;
+    }
+    gpiod_add_lookup_table(&ds1302_lookup);
+
+    ds1302_pdev = platform_device_register_simple(DRIVER_NAME, PLATFORM_DEVID_NONE, NULL, 0);
+    if (IS_ERR(ds1302_pdev)) {
+        ret = PTR_ERR(ds1302_pdev);
+        printk("DS1302: RTC device registration failed\n");
+        goto err_lookup;
+    }
+
+    ret = ds1302_gpio_get(&ds1302_pdev->dev);
+    if (ret) {
         printk("DS1302: GPIO Request Failed\n");
-        return -1;
+        goto err_pdev;
     }
 
-    gpio_direction_output(DS1302_CLK, 0);
-    gpio_direction_output(DS1302_RST, 0);
-    gpio_direction_output(DS1302_DAT, 0);
+    /* 노드가 보이는 순간 open/poll이 타이머를 걸 수 있으므로 먼저 초기화 */
+    hrtimer_init(&alarm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    alarm_timer.function = ds1302_alarm_fire;
+    hrtimer_init(&tick_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    tick_timer.function = ds1302_tick_fire;
 
-    if (alloc_chrdev_region(&dev_num, 0, 1, DRIVER_NAME) < 0)
-        return -1;
+    ret = alloc_chrdev_region(&dev_num, 0, 1, DRIVER_NAME);
+    if (ret)
+        goto err_gpio;
 
     cdev_init(&my_cdev, &fops);
-    cdev_add(&my_cdev, dev_num, 1);
+    ret = cdev_add(&my_cdev, dev_num, 1);
+    if (ret)
+        goto err_region;
 
     my_class = class_create(THIS_MODULE, CLASS_NAME);
-    device_create(my_class, NULL, dev_num, NULL, DRIVER_NAME);
+    if (IS_ERR(my_class)) {
+        ret = PTR_ERR(my_class);
+        goto err_cdev;
+    }
+    node = device_create_with_groups(my_class, NULL, dev_num, NULL, ds1302_groups, DRIVER_NAME);
+    if (IS_ERR(node)) {
+        ret = PTR_ERR(node);
+        goto err_class;
+    }
+
+    ret = platform_driver_register(&ds1302_rtc_driver);
+    if (ret) {
+        printk("DS1302: RTC driver registration failed\n");
+        goto err_node;
+    }
+    /* probe는 등록 중에 동기로 돌고, 실패해도 driver_register는 0을 돌려줌 */
+    if (!READ_ONCE(ds1302_rtc)) {
+        printk("DS1302: RTC probe failed\n");
+        platform_driver_unregister(&ds1302_rtc_driver);
+        ret = -ENODEV;
+        goto err_node;
+    }
 
-    printk("DS1302 Driver Initialized (GPIO %d,%d,%d)\n", DS1302_CLK, DS1302_DAT, DS1302_RST);
+    printk("DS1302 Driver Initialized (GPIO %d,%d,%d, %u kHz)\n", clk_gpio, dat_gpio, rst_gpio, clk_khz);
     return 0;
+
+err_node:
+    device_destroy(my_class, dev_num);
+err_class:
+    class_destroy(my_class);
+err_cdev:
+    cdev_del(&my_cdev);
+err_region:
+    unregister_chrdev_region(dev_num, 1);
+err_gpio:
+    hrtimer_cancel(&tick_timer);
+    ds1302_gpio_put();
+err_pdev:
+    platform_device_unregister(ds1302_pdev);
+err_lookup:
+    gpiod_remove_lookup_table(&ds1302_lookup);
+    return ret;
 }
 
 static void __exit ds1302_exit(void)
 {
-    gpio_set_value(DS1302_RST, 0);
-
-    gpio_free(DS1302_CLK);
-    gpio_free(DS1302_DAT);
-    gpio_free(DS1302_RST);
+    /* remove()에서 알람 타이머를 멈춘 뒤 rtc가 해제됨 */
+    platform_driver_unregister(&ds1302_rtc_driver);
 
     device_destroy(my_class, dev_num);
     class_destroy(my_class);
     cdev_del(&my_cdev);
     unregister_chrdev_region(dev_num, 1);
+
+    hrtimer_cancel(&tick_timer);
+    ds1302_gpio_put();
+    platform_device_unregister(ds1302_pdev);
+    gpiod_remove_lookup_table(&ds1302_lookup);
 }
 
 module_init(ds1302_init);
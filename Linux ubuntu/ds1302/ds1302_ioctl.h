@@ -0,0 +1,46 @@
+/*
+ * ds1302_ioctl.h - userspace interface of /dev/ds1302_driver
+ *
+ * Shared by the kernel module and applications (main1.c).
+ */
+#ifndef DS1302_IOCTL_H
+#define DS1302_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Clock registers in chip (burst) order, BCD, 24-hour mode.
+ * sec bit 7 is the clock-halt flag; year is 00..99 (20YY).
+ * wday is 1..7, its meaning is up to the application.
+ */
+struct ds1302_regs {
+    __u8 sec;
+    __u8 min;
+    __u8 hour;
+    __u8 mday;
+    __u8 mon;
+    __u8 wday;
+    __u8 year;
+    __u8 reserved;
+};
+
+/* Battery-backed RAM, always transferred whole in one burst */
+#define DS1302_RAM_SIZE  31
+
+struct ds1302_ram {
+    __u8 data[DS1302_RAM_SIZE];
+    __u8 reserved;
+};
+
+#define DS1302_IOC_MAGIC       'D'
+
+/* Current time (served from the driver's cache like read()) */
+#define DS1302_IOC_GET_REGS    _IOR(DS1302_IOC_MAGIC, 0, struct ds1302_regs)
+/* Set the time, clears clock-halt */
+#define DS1302_IOC_SET_REGS    _IOW(DS1302_IOC_MAGIC, 1, struct ds1302_regs)
+/* RAM burst read / write (0xFF / 0xFE) */
+#define DS1302_IOC_RAM_READ    _IOR(DS1302_IOC_MAGIC, 2, struct ds1302_ram)
+#define DS1302_IOC_RAM_WRITE   _IOW(DS1302_IOC_MAGIC, 3, struct ds1302_ram)
+
+#endif /* DS1302_IOCTL_H */
@@ -2,17 +2,63 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/i2c.h>
+#include <linux/spi/spi.h>
+#include <linux/gpio/consumer.h>
+#include <linux/idr.h>
+#include <linux/kref.h>
 #include <linux/fs.h>
 #include <linux/cdev.h>
 #include <linux/uaccess.h>
 #include <linux/slab.h>
+#include <linux/cache.h>
 #include <linux/delay.h>
+#include <linux/mutex.h>
+#include <linux/mm.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/fb.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "ssd1306_ioctl.h"
 
 #define DRIVER_NAME "ssd1306_driver"
 #define CLASS_NAME  "ssd1306_class"
 
 #define SSD1306_I2C_ADDR   0x3C
-#define MAX_BUFFER_SIZE   1024
+#define SSD1306_MAX_DEVICES 4
+#define SSD1306_SPI_DEFAULT_HZ 8000000
+#define MAX_BUFFER_SIZE   SSD1306_FB_SIZE
+
+#define SSD1306_WIDTH     SSD1306_FB_WIDTH
+#define SSD1306_PAGES     (SSD1306_FB_HEIGHT / 8)
+
+/*
+ * Unchanged runs shorter than this are sent anyway instead of splitting
+ * the span: a new window costs a 7-byte command transaction plus an
+ * extra start/address/stop on the bus.
+ */
+#define SSD1306_SPAN_MERGE_GAP 8
+
+/* fbdev: deferred I/O collects drawing for this long before a flush */
+#define SSD1306_FB_DEFIO_DELAY (HZ / 20)
+#define SSD1306_FB_LINE_LENGTH (SSD1306_FB_WIDTH / 8)
+
+static bool fbdev;
+module_param(fbdev, bool, 0444);
+MODULE_PARM_DESC(fbdev, "Also register a standard fbdev (/dev/fbN) with deferred I/O");
+
+static unsigned int max_fps;
+module_param(max_fps, uint, 0444);
+MODULE_PARM_DESC(max_fps, "Initial frame rate limit, 0 = as fast as the bus allows");
+
+#define SSD1306_MAX_FPS 200
+
+/* I2C latency histogram: bucket i counts transfers of [2^i, 2^(i+1)) us */
+#define SSD1306_LAT_BUCKETS 16
 
 /* SSD1306 Commands */
 #define SSD1306_DISPLAYOFF          0xAE
@@ -23,6 +69,8 @@
 #define SSD1306_SETSTARTLINE        0x40
 #define SSD1306_CHARGEPUMP          0x8D
 #define SSD1306_MEMORYMODE          0x20
+#define SSD1306_COLUMNADDR          0x21
+#define SSD1306_PAGEADDR            0x22
 #define SSD1306_SEGREMAP            0xA1
 #define SSD1306_COMSCANDEC          0xC8
 #define SSD1306_SETCOMPINS          0xDA
@@ -31,178 +79,1468 @@
 #define SSD1306_SETVCOMDETECT       0xDB
 #define SSD1306_DISPLAYALLON_RESUME 0xA4
 #define SSD1306_NORMALDISPLAY       0xA6
+#define SSD1306_RIGHT_HSCROLL       0x26
+#define SSD1306_LEFT_HSCROLL        0x27
+#define SSD1306_DEACTIVATE_SCROLL   0x2E
+#define SSD1306_ACTIVATE_SCROLL     0x2F
+
+/* Inclusive column/page rectangle of the framebuffer, empty if c0 > c1 */
+struct ssd1306_area {
+    int c0, c1;
+    int p0, p1;
+};
+
+struct ssd1306_dev;
+
+/*
+ * Bus access. buf[0] is the SSD1306 I2C control byte (0x00 = commands,
+ * 0x40 = data) followed by the payload; SPI maps it onto the D/C line.
+ */
+struct ssd1306_transport {
+    const char *name;
+    int (*write)(struct ssd1306_dev *dev, const u8 *buf, size_t len);
+};
 
 struct ssd1306_dev {
+    struct device *parent;            /* i2c_client or spi_device */
+    const struct ssd1306_transport *tr;
     struct i2c_client *client;
-    struct cdev cdev;
-    struct class *class;
+    struct spi_device *spi;
+    struct gpio_desc *dc;             /* SPI data/command select */
+    struct gpio_desc *reset;          /* optional */
+    int id;
+    struct cdev *cdev;                /* allocated, may outlive dev */
     dev_t dev_num;
+
+    /*
+     * Held by the bound driver and by every open file (and so by every
+     * mapping of fb). dead is set at remove under lock and fb_lock;
+     * from then on file operations fail with ENODEV.
+     */
+    struct kref ref;
+    bool dead;
+
+    struct mutex lock;                /* bus + shadow, held by the flusher */
+    u8 shadow[MAX_BUFFER_SIZE];       /* copy of what the panel GRAM holds */
+    bool shadow_valid;
+
+    struct mutex fb_lock;             /* fb, pending frame, sequence numbers */
+    u8 *fb;                           /* page shared with userspace (mmap) */
+    u8 *pending;                      /* latest submitted frame */
+    bool pending_new;                 /* pending not yet taken by worker */
+    u8 *frame;                        /* frame being flushed by the worker */
+    u8 xfer[2][MAX_BUFFER_SIZE];      /* backing store for pending/frame */
+    struct ssd1306_area dirty;        /* union of areas since last flush */
+    u64 submit_seq;                   /* frames handed to the worker */
+    u64 flush_seq;                    /* last frame that reached the panel */
+    u64 frames_dropped;               /* replaced before reaching the panel */
+    int flush_err;
+    bool hscroll;                     /* hardware scroll on, GRAM is locked */
+
+    struct delayed_work flush_work;
+    wait_queue_head_t flush_wq;
+    unsigned int max_fps;             /* 0 = no frame rate limit */
+    ktime_t last_flush;               /* start of the last transfer */
+    u64 flush_ts_ns;                  /* completion time of flush_seq */
+    u64 last_ok_ns;                   /* end of the last good transfer */
+
+    /* Transfer statistics, updated under dev->lock */
+    u64 frames_flushed;
+    u64 tx_bytes;
+    u64 xfers;                        /* bus transactions */
+    u64 xfer_errors;
+    u64 lat_min_ns, lat_max_ns, lat_sum_ns;
+    u64 lat_hist[SSD1306_LAT_BUCKETS];
+    struct dentry *debugfs;
+
+    struct fb_info *info;             /* optional fbdev front end */
+#ifdef CONFIG_FB_DEFERRED_IO
+    struct fb_deferred_io defio;      /* holds per-device page list state */
+#endif
+
+    /*
+     * Bus buffers, used under dev->lock. Kept out of the stack so SPI
+     * controllers may DMA from them.
+     */
+    u8 cmd_buf[1 + SSD1306_MAX_CMDS] ____cacheline_aligned;
+    /* 0x40 data control byte followed by the span being sent */
+    u8 tx_buf[1 + MAX_BUFFER_SIZE] ____cacheline_aligned;
 };
 
-static struct ssd1306_dev *ssd1306_device;
+static struct class *ssd1306_class;
+static dev_t ssd1306_devt;
+static DEFINE_IDR(ssd1306_idr);             /* minor -> dev */
+static DEFINE_MUTEX(ssd1306_idr_lock);      /* idr + kref_get in open */
+static struct dentry *ssd1306_debugfs_root;
 
-/* ================= I2C Write ================= */
+/* ================= Transports ================= */
 
-/* Control Byte 0x00 = Command */
-static int ssd1306_write_cmd(struct ssd1306_dev *dev, u8 cmd)
+static int ssd1306_i2c_write(struct ssd1306_dev *dev, const u8 *buf,
+                             size_t len)
 {
-    u8 buf[2] = { 0x00, cmd };
-    return i2c_master_send(dev->client, buf, 2);
+    return i2c_master_send(dev->client, buf, len);
 }
 
-/* Control Byte 0x40 = Data */
-static int ssd1306_write_data(struct ssd1306_dev *dev, u8 *data, size_t len)
+static const struct ssd1306_transport ssd1306_i2c_transport = {
+    .name  = "I2C",
+    .write = ssd1306_i2c_write,
+};
+
+#if IS_ENABLED(CONFIG_SPI_MASTER)
+/* 4-wire SPI: D/C low for commands, high for GRAM data */
+static int ssd1306_spi_write(struct ssd1306_dev *dev, const u8 *buf,
+                             size_t len)
 {
-    u8 *buf;
     int ret;
 
-    buf = kmalloc(len + 1, GFP_KERNEL);
-    if (!buf)
-        return -ENOMEM;
+    gpiod_set_value_cansleep(dev->dc, buf[0] == 0x40);
+
+    ret = spi_write(dev->spi, &buf[1], len - 1);
+    return ret < 0 ? ret : len;
+}
+
+static const struct ssd1306_transport ssd1306_spi_transport = {
+    .name  = "SPI",
+    .write = ssd1306_spi_write,
+};
+#endif
 
-    buf[0] = 0x40;
-    memcpy(&buf[1], data, len);
+/* ================= Bus Write ================= */
 
-    ret = i2c_master_send(dev->client, buf, len + 1);
-    kfree(buf);
+/* Every transfer goes through here so bus time can be accounted */
+static int ssd1306_send(struct ssd1306_dev *dev, const u8 *buf, int len)
+{
+    u64 t0, ns;
+    int ret, b;
+
+    /* The bus device may be gone once remove has run */
+    if (dev->dead)
+        return -ENODEV;
+
+    t0 = ktime_get_ns();
+    ret = dev->tr->write(dev, buf, len);
+    ns = ktime_get_ns() - t0;
+
+    dev->xfers++;
+    if (ret < 0) {
+        dev->xfer_errors++;
+        return ret;
+    }
+
+    dev->tx_bytes += len;
+    if (!dev->lat_min_ns || ns < dev->lat_min_ns)
+        dev->lat_min_ns = ns;
+    dev->lat_max_ns = max(dev->lat_max_ns, ns);
+    dev->lat_sum_ns += ns;
+
+    b = ns < NSEC_PER_USEC ? 0 : ilog2(ns / NSEC_PER_USEC);
+    dev->lat_hist[min(b, SSD1306_LAT_BUCKETS - 1)]++;
 
     return ret;
 }
 
+/*
+ * Control Byte 0x00 = Command stream: with Co=0 every following byte is
+ * a command, so a whole sequence costs one start/address/stop. Called
+ * with dev->lock held.
+ */
+static int ssd1306_write_cmds(struct ssd1306_dev *dev,
+                              const u8 *cmds, size_t len)
+{
+    if (len > SSD1306_MAX_CMDS)
+        return -EINVAL;
+
+    dev->cmd_buf[0] = 0x00;
+    memcpy(&dev->cmd_buf[1], cmds, len);
+    return ssd1306_send(dev, dev->cmd_buf, len + 1);
+}
+
+static int ssd1306_write_cmd(struct ssd1306_dev *dev, u8 cmd)
+{
+    return ssd1306_write_cmds(dev, &cmd, 1);
+}
+
+/*
+ * Control Byte 0x40 = Data. dev->tx_buf[0] is set once at probe, so the
+ * hot path is a single copy into the preallocated buffer. Called with
+ * dev->lock held.
+ */
+static int ssd1306_write_data(struct ssd1306_dev *dev, const u8 *data,
+                              size_t len)
+{
+    memcpy(&dev->tx_buf[1], data, len);
+
+    return ssd1306_send(dev, dev->tx_buf, len + 1);
+}
+
+/* Restrict GRAM writes to columns c0..c1 of pages p0..p1 */
+static int ssd1306_set_window(struct ssd1306_dev *dev,
+                              u8 c0, u8 c1, u8 p0, u8 p1)
+{
+    const u8 cmds[] = { SSD1306_COLUMNADDR, c0, c1,
+                        SSD1306_PAGEADDR,   p0, p1 };
+    return ssd1306_write_cmds(dev, cmds, sizeof(cmds));
+}
+
+/* ================= Partial Flush ================= */
+
+static int ssd1306_send_span(struct ssd1306_dev *dev, const u8 *frame,
+                             int page, int c0, int c1)
+{
+    size_t off = page * SSD1306_WIDTH + c0;
+    size_t len = c1 - c0 + 1;
+    int ret;
+
+    ret = ssd1306_set_window(dev, c0, c1, page, page);
+    if (ret < 0)
+        return ret;
+
+    memcpy(&dev->shadow[off], &frame[off], len);
+
+    ret = ssd1306_write_data(dev, &dev->shadow[off], len);
+    if (ret < 0)
+        return ret;
+
+    return 0;
+}
+
+/*
+ * Push area a of frame to the panel, sending only the spans that differ
+ * from the shadow GRAM. Spans never cross a page boundary, and spans
+ * separated by fewer than SSD1306_SPAN_MERGE_GAP equal bytes are merged
+ * into one window. Called with dev->lock held.
+ */
+static int ssd1306_flush(struct ssd1306_dev *dev, const u8 *frame,
+                         const struct ssd1306_area *a)
+{
+    int page, col, start, end, ret;
+
+    if (!dev->shadow_valid) {
+        /* GRAM content unknown: one full window, one data burst */
+        ret = ssd1306_set_window(dev, 0, SSD1306_WIDTH - 1,
+                                 0, SSD1306_PAGES - 1);
+        if (ret < 0)
+            return ret;
+
+        memcpy(dev->shadow, frame, MAX_BUFFER_SIZE);
+        ret = ssd1306_write_data(dev, dev->shadow, MAX_BUFFER_SIZE);
+        if (ret < 0)
+            return ret;
+
+        dev->shadow_valid = true;
+        return 0;
+    }
+
+    for (page = a->p0; page <= a->p1; page++) {
+        const u8 *new = &frame[page * SSD1306_WIDTH];
+        const u8 *old = &dev->shadow[page * SSD1306_WIDTH];
+
+        col = a->c0;
+        while (col <= a->c1) {
+            if (new[col] == old[col]) {
+                col++;
+                continue;
+            }
+
+            start = end = col;
+            for (col = start + 1; col <= a->c1; col++) {
+                if (new[col] != old[col])
+                    end = col;
+                else if (col - end > SSD1306_SPAN_MERGE_GAP)
+                    break;
+            }
+
+            ret = ssd1306_send_span(dev, frame, page, start, end);
+            if (ret < 0) {
+                /* GRAM is now only partially updated */
+                dev->shadow_valid = false;
+                return ret;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* ================= Flush Worker ================= */
+
+static const struct ssd1306_area ssd1306_full_area = {
+    0, SSD1306_WIDTH - 1, 0, SSD1306_PAGES - 1
+};
+
+static void ssd1306_area_clear(struct ssd1306_area *a)
+{
+    a->c0 = SSD1306_WIDTH;
+    a->c1 = -1;
+    a->p0 = SSD1306_PAGES;
+    a->p1 = -1;
+}
+
+static void ssd1306_area_merge(struct ssd1306_area *a,
+                               const struct ssd1306_area *b)
+{
+    a->c0 = min(a->c0, b->c0);
+    a->c1 = max(a->c1, b->c1);
+    a->p0 = min(a->p0, b->p0);
+    a->p1 = max(a->p1, b->p1);
+}
+
+/* Called with dev->fb_lock held */
+static void ssd1306_kick(struct ssd1306_dev *dev)
+{
+    /* No-op if already queued, so a governor delay is kept */
+    if (!dev->dead)
+        schedule_delayed_work(&dev->flush_work, 0);
+}
+
+/* Called with dev->fb_lock held */
+static void ssd1306_frame_done(struct ssd1306_dev *dev, u64 seq, int err)
+{
+    dev->flush_seq = seq;
+    dev->flush_err = err;
+    dev->flush_ts_ns = ktime_get_ns();
+}
+
+/*
+ * Takes whatever frame was submitted last; frames submitted while a
+ * transfer is running or while the frame rate budget is used up simply
+ * overwrite dev->pending (latest wins).
+ */
+static void ssd1306_flush_work(struct work_struct *work)
+{
+    struct ssd1306_dev *dev = container_of(to_delayed_work(work),
+                                           struct ssd1306_dev, flush_work);
+    unsigned int fps = READ_ONCE(dev->max_fps);
+    struct ssd1306_area area;
+    u64 seq;
+    int ret = 0;
+
+    if (fps) {
+        s64 wait_ns = ktime_to_ns(ktime_sub(
+                ktime_add_ns(dev->last_flush, NSEC_PER_SEC / fps),
+                ktime_get()));
+
+        if (wait_ns > 0) {
+            schedule_delayed_work(&dev->flush_work,
+                                  max(1UL, nsecs_to_jiffies(wait_ns)));
+            return;
+        }
+    }
+
+    /*
+     * dev->lock first, like HSCROLL_START, so a scroll cannot start
+     * between taking the frame and writing it to GRAM.
+     */
+    mutex_lock(&dev->lock);
+    mutex_lock(&dev->fb_lock);
+    /*
+     * Scrolling: keep the frame pending, HSCROLL_STOP sends it and only
+     * then does flush_seq move. No new frame (SET_FPS kick): dev->frame
+     * must stay the last frame taken, HSCROLL_STOP resends it.
+     */
+    if (dev->hscroll || !dev->pending_new) {
+        mutex_unlock(&dev->fb_lock);
+        mutex_unlock(&dev->lock);
+        return;
+    }
+    swap(dev->pending, dev->frame);
+    dev->pending_new = false;
+    area = dev->dirty;
+    ssd1306_area_clear(&dev->dirty);
+    seq = dev->submit_seq;
+    mutex_unlock(&dev->fb_lock);
+
+    if (area.c0 <= area.c1) {
+        dev->last_flush = ktime_get();
+
+        ret = ssd1306_flush(dev, dev->frame, &area);
+        if (!ret) {
+            dev->frames_flushed++;
+            WRITE_ONCE(dev->last_ok_ns, ktime_get_ns());
+        }
+    }
+    mutex_unlock(&dev->lock);
+
+    mutex_lock(&dev->fb_lock);
+    ssd1306_frame_done(dev, seq, ret);
+    mutex_unlock(&dev->fb_lock);
+
+    wake_up_interruptible_all(&dev->flush_wq);
+}
+
+/*
+ * Snapshot the framebuffer as the next frame and kick the worker.
+ * Called with dev->fb_lock held; returns the frame's sequence number.
+ */
+static u64 ssd1306_submit(struct ssd1306_dev *dev,
+                          const struct ssd1306_area *a)
+{
+    if (dev->pending_new)
+        dev->frames_dropped++;
+
+    memcpy(dev->pending, dev->fb, MAX_BUFFER_SIZE);
+    dev->pending_new = true;
+    ssd1306_area_merge(&dev->dirty, a);
+    dev->submit_seq++;
+
+    ssd1306_kick(dev);
+    return dev->submit_seq;
+}
+
+static bool ssd1306_flushed(struct ssd1306_dev *dev, u64 seq)
+{
+    return READ_ONCE(dev->flush_seq) >= seq;
+}
+
+/*
+ * Wait until frame seq is on the panel, return its transfer status.
+ * While a hardware scroll runs the frame stays pending: EBUSY.
+ */
+static int ssd1306_wait_flush(struct ssd1306_dev *dev, u64 seq)
+{
+    int ret;
+
+    ret = wait_event_interruptible(dev->flush_wq,
+                                   ssd1306_flushed(dev, seq) ||
+                                   READ_ONCE(dev->hscroll) ||
+                                   READ_ONCE(dev->dead));
+    if (ret)
+        return ret;
+    if (READ_ONCE(dev->dead))
+        return -ENODEV;
+    if (!ssd1306_flushed(dev, seq))
+        return -EBUSY;
+
+    return READ_ONCE(dev->flush_err);
+}
+
+/* Submit area a; O_NONBLOCK files return without waiting for the bus */
+static int ssd1306_queue_frame(struct ssd1306_dev *dev, struct file *file,
+                               const struct ssd1306_area *a)
+{
+    u64 seq;
+
+    mutex_lock(&dev->fb_lock);
+    seq = ssd1306_submit(dev, a);
+    mutex_unlock(&dev->fb_lock);
+
+    if (file->f_flags & O_NONBLOCK)
+        return 0;
+
+    return ssd1306_wait_flush(dev, seq);
+}
+
 /* ================= Init Sequence ================= */
 
-static void ssd1306_init_seq(struct ssd1306_dev *dev)
+static const u8 ssd1306_init_cmds[] = {
+    SSD1306_DISPLAYOFF,
+    SSD1306_SETDISPLAYCLOCKDIV, 0x80,
+    SSD1306_SETMULTIPLEX, 0x3F,
+    SSD1306_SETDISPLAYOFFSET, 0x00,
+    SSD1306_SETSTARTLINE | 0x00,
+    SSD1306_CHARGEPUMP, 0x14,
+    SSD1306_MEMORYMODE, 0x00,
+    SSD1306_SEGREMAP,
+    SSD1306_COMSCANDEC,
+    SSD1306_SETCOMPINS, 0x12,
+    SSD1306_SETCONTRAST, 0xCF,
+    SSD1306_SETPRECHARGE, 0xF1,
+    SSD1306_SETVCOMDETECT, 0x40,
+    SSD1306_DISPLAYALLON_RESUME,
+    SSD1306_NORMALDISPLAY,
+    SSD1306_DISPLAYON,
+};
+
+/* Whole init sequence in a single bus transaction */
+static int ssd1306_init_seq(struct ssd1306_dev *dev)
 {
-    ssd1306_write_cmd(dev, SSD1306_DISPLAYOFF);
+    return ssd1306_write_cmds(dev, ssd1306_init_cmds,
+                              sizeof(ssd1306_init_cmds));
+}
+
+/*
+ * Argument bytes following command op, or -1 if the batch may not use
+ * it. This is an allow-list of the datasheet opcodes: an unknown opcode
+ * has an unknown length, so the walk could not tell its arguments from
+ * the next command. The scroll commands are refused too; they are only
+ * allowed through the HSCROLL ioctls, which keep dev->hscroll in step
+ * with the panel.
+ */
+static int ssd1306_cmd_args(u8 op)
+{
+    switch (op) {
+    case 0x00 ... 0x0F:                /* lower column start (page mode) */
+    case 0x10 ... 0x1F:                /* higher column start (page mode) */
+    case 0x40 ... 0x7F:                /* SSD1306_SETSTARTLINE | line */
+    case 0xB0 ... 0xB7:                /* page start (page mode) */
+    case 0xA0:                         /* segment remap off */
+    case SSD1306_SEGREMAP:
+    case SSD1306_DISPLAYALLON_RESUME:
+    case 0xA5:                         /* entire display on */
+    case SSD1306_NORMALDISPLAY:
+    case 0xA7:                         /* inverse display */
+    case SSD1306_DISPLAYOFF:
+    case SSD1306_DISPLAYON:
+    case 0xC0:                         /* COM scan increment */
+    case SSD1306_COMSCANDEC:
+    case 0xE3:                         /* NOP */
+        return 0;
+    case SSD1306_MEMORYMODE:
+    case 0x23:                         /* fade out / blink */
+    case SSD1306_SETCONTRAST:
+    case SSD1306_CHARGEPUMP:
+    case SSD1306_SETMULTIPLEX:
+    case SSD1306_SETDISPLAYOFFSET:
+    case SSD1306_SETDISPLAYCLOCKDIV:
+    case 0xD6:                         /* zoom in */
+    case SSD1306_SETPRECHARGE:
+    case SSD1306_SETCOMPINS:
+    case SSD1306_SETVCOMDETECT:
+        return 1;
+    case SSD1306_COLUMNADDR:
+    case SSD1306_PAGEADDR:
+    case 0xA3:                         /* vertical scroll area */
+        return 2;
+    default:                           /* scroll commands, unknown */
+        return -1;
+    }
+}
+
+/*
+ * Run a userspace command batch. Horizontal addressing mode is restored
+ * in the same transaction so a batch cannot break the partial flush.
+ * The batch is walked command by command so an argument byte is never
+ * mistaken for an opcode, and a truncated last command is rejected
+ * (the appended bytes would become its arguments).
+ */
+static int ssd1306_run_cmds(struct ssd1306_dev *dev,
+                            const struct ssd1306_cmds *c)
+{
+    u8 cmds[SSD1306_MAX_CMDS];
+    int i, n, ret;
+
+    if (c->len > SSD1306_MAX_CMDS - 2)
+        return -EINVAL;
+
+    for (i = 0; i < c->len; i += 1 + n) {
+        n = ssd1306_cmd_args(c->cmds[i]);
+        if (n < 0 || i + n >= c->len)
+            return -EINVAL;
+    }
+
+    memcpy(cmds, c->cmds, c->len);
+    cmds[c->len] = SSD1306_MEMORYMODE;
+    cmds[c->len + 1] = 0x00;
+
+    mutex_lock(&dev->lock);
+    ret = ssd1306_write_cmds(dev, cmds, c->len + 2);
+    mutex_unlock(&dev->lock);
+
+    return ret < 0 ? ret : 0;
+}
 
-    ssd1306_write_cmd(dev, SSD1306_SETDISPLAYCLOCKDIV);
-    ssd1306_write_cmd(dev, 0x80);
+/* ================= Scrolling ================= */
 
-    ssd1306_write_cmd(dev, SSD1306_SETMULTIPLEX);
-    ssd1306_write_cmd(dev, 0x3F);
+/* Start line / display offset only move the viewport, GRAM is untouched */
+static int ssd1306_vscroll(struct ssd1306_dev *dev,
+                           const struct ssd1306_vscroll *v)
+{
+    u8 cmds[3];
+    int ret;
+
+    if (v->start_line >= SSD1306_FB_HEIGHT ||
+        v->display_offset >= SSD1306_FB_HEIGHT)
+        return -EINVAL;
+
+    cmds[0] = SSD1306_SETSTARTLINE | v->start_line;
+    cmds[1] = SSD1306_SETDISPLAYOFFSET;
+    cmds[2] = v->display_offset;
+
+    mutex_lock(&dev->lock);
+    ret = ssd1306_write_cmds(dev, cmds, sizeof(cmds));
+    mutex_unlock(&dev->lock);
+
+    return ret < 0 ? ret : 0;
+}
 
-    ssd1306_write_cmd(dev, SSD1306_SETDISPLAYOFFSET);
-    ssd1306_write_cmd(dev, 0x00);
+static int ssd1306_hscroll_start(struct ssd1306_dev *dev,
+                                 const struct ssd1306_hscroll *h)
+{
+    u8 cmds[9];
+    int ret;
 
-    ssd1306_write_cmd(dev, SSD1306_SETSTARTLINE | 0x00);
+    if (h->direction > SSD1306_HSCROLL_LEFT ||
+        h->start_page > h->end_page || h->end_page >= SSD1306_PAGES ||
+        h->interval > 7)
+        return -EINVAL;
 
-    ssd1306_write_cmd(dev, SSD1306_CHARGEPUMP);
-    ssd1306_write_cmd(dev, 0x14);
+    cmds[0] = SSD1306_DEACTIVATE_SCROLL;
+    cmds[1] = h->direction == SSD1306_HSCROLL_LEFT ?
+              SSD1306_LEFT_HSCROLL : SSD1306_RIGHT_HSCROLL;
+    cmds[2] = 0x00;
+    cmds[3] = h->start_page;
+    cmds[4] = h->interval;
+    cmds[5] = h->end_page;
+    cmds[6] = 0x00;
+    cmds[7] = 0xFF;
+    cmds[8] = SSD1306_ACTIVATE_SCROLL;
 
-    ssd1306_write_cmd(dev, SSD1306_MEMORYMODE);
-    ssd1306_write_cmd(dev, 0x00);
+    mutex_lock(&dev->lock);
+    mutex_lock(&dev->fb_lock);
+    WRITE_ONCE(dev->hscroll, true);
+    mutex_unlock(&dev->fb_lock);
+    /* Frames already waiting for the bus now fail with EBUSY */
+    wake_up_interruptible_all(&dev->flush_wq);
 
-    ssd1306_write_cmd(dev, SSD1306_SEGREMAP);
-    ssd1306_write_cmd(dev, SSD1306_COMSCANDEC);
+    ret = ssd1306_write_cmds(dev, cmds, sizeof(cmds));
+    /* Scrolling rotates GRAM in place, the shadow no longer matches */
+    dev->shadow_valid = false;
+    if (ret < 0) {
+        /* Panel is not scrolling: release the held frame */
+        mutex_lock(&dev->fb_lock);
+        WRITE_ONCE(dev->hscroll, false);
+        ssd1306_area_merge(&dev->dirty, &ssd1306_full_area);
+        ssd1306_kick(dev);
+        mutex_unlock(&dev->fb_lock);
+    }
+    mutex_unlock(&dev->lock);
 
-    ssd1306_write_cmd(dev, SSD1306_SETCOMPINS);
-    ssd1306_write_cmd(dev, 0x12);
+    return ret < 0 ? ret : 0;
+}
 
-    ssd1306_write_cmd(dev, SSD1306_SETCONTRAST);
-    ssd1306_write_cmd(dev, 0xCF);
+static int ssd1306_hscroll_stop(struct ssd1306_dev *dev)
+{
+    int ret;
 
-    ssd1306_write_cmd(dev, SSD1306_SETPRECHARGE);
-    ssd1306_write_cmd(dev, 0xF1);
+    mutex_lock(&dev->lock);
+    ret = ssd1306_write_cmd(dev, SSD1306_DEACTIVATE_SCROLL);
+    dev->shadow_valid = false;
+    mutex_unlock(&dev->lock);
 
-    ssd1306_write_cmd(dev, SSD1306_SETVCOMDETECT);
-    ssd1306_write_cmd(dev, 0x40);
+    /* Rewrite the latest frame in full */
+    mutex_lock(&dev->fb_lock);
+    if (!dev->pending_new) {
+        memcpy(dev->pending, dev->frame, MAX_BUFFER_SIZE);
+        dev->pending_new = true;
+    }
+    WRITE_ONCE(dev->hscroll, false);
+    ssd1306_area_merge(&dev->dirty, &ssd1306_full_area);
+    ssd1306_kick(dev);
+    mutex_unlock(&dev->fb_lock);
 
-    ssd1306_write_cmd(dev, SSD1306_DISPLAYALLON_RESUME);
-    ssd1306_write_cmd(dev, SSD1306_NORMALDISPLAY);
-    ssd1306_write_cmd(dev, SSD1306_DISPLAYON);
+    return ret < 0 ? ret : 0;
 }
 
 /* ================= File Operations ================= */
 
+/* Per-open state: last frame-done event this file has consumed */
+struct ssd1306_file {
+    struct ssd1306_dev *dev;
+    u64 seen_seq;
+};
+
+static void ssd1306_dev_release(struct kref *ref)
+{
+    struct ssd1306_dev *dev = container_of(ref, struct ssd1306_dev, ref);
+
+    free_page((unsigned long)dev->fb);
+    kfree(dev);
+}
+
+static void ssd1306_dev_put(struct ssd1306_dev *dev)
+{
+    kref_put(&dev->ref, ssd1306_dev_release);
+}
+
 static int ssd1306_open(struct inode *inode, struct file *file)
 {
+    struct ssd1306_dev *dev;
+    struct ssd1306_file *f;
+
+    f = kzalloc(sizeof(*f), GFP_KERNEL);
+    if (!f)
+        return -ENOMEM;
+
+    mutex_lock(&ssd1306_idr_lock);
+    dev = idr_find(&ssd1306_idr, iminor(inode));
+    if (dev)
+        kref_get(&dev->ref);
+    mutex_unlock(&ssd1306_idr_lock);
+    if (!dev) {
+        kfree(f);
+        return -ENODEV;
+    }
+
+    f->dev = dev;
+    f->seen_seq = READ_ONCE(dev->flush_seq);
+    file->private_data = f;
     return 0;
 }
 
+/*
+ * A mapping holds the file, so this also runs only after the last
+ * munmap: fb is never freed under a user mapping.
+ */
 static int ssd1306_release(struct inode *inode, struct file *file)
 {
+    struct ssd1306_file *f = file->private_data;
+
+    ssd1306_dev_put(f->dev);
+    kfree(f);
+    return 0;
+}
+
+static int ssd1306_set_fps(struct ssd1306_dev *dev, unsigned int fps)
+{
+    if (fps > SSD1306_MAX_FPS)
+        return -EINVAL;
+
+    WRITE_ONCE(dev->max_fps, fps);
+    /* Re-evaluate a frame held back under the old limit */
+    mutex_lock(&dev->fb_lock);
+    if (!dev->dead)
+        mod_delayed_work(system_wq, &dev->flush_work, 0);
+    mutex_unlock(&dev->fb_lock);
     return 0;
 }
 
+/*
+ * A write() replaces the start of the framebuffer and queues it. In
+ * blocking mode it returns once the frame is on the panel; with
+ * O_NONBLOCK it returns right away and fsync()/poll() report completion.
+ */
 static ssize_t ssd1306_write(struct file *file,
                              const char __user *buf,
                              size_t count,
                              loff_t *ppos)
 {
-    u8 *kbuf;
+    struct ssd1306_file *f = file->private_data;
+    struct ssd1306_dev *dev = f->dev;
+    u64 seq;
+    int ret;
+
+    if (READ_ONCE(dev->dead))
+        return -ENODEV;
 
     if (count > MAX_BUFFER_SIZE)
         count = MAX_BUFFER_SIZE;
 
-    kbuf = kmalloc(count, GFP_KERNEL);
-    if (!kbuf)
-        return -ENOMEM;
-
-    if (copy_from_user(kbuf, buf, count)) {
-        kfree(kbuf);
+    mutex_lock(&dev->fb_lock);
+    if (copy_from_user(dev->fb, buf, count)) {
+        mutex_unlock(&dev->fb_lock);
         return -EFAULT;
     }
+    seq = ssd1306_submit(dev, &ssd1306_full_area);
+    mutex_unlock(&dev->fb_lock);
 
-    ssd1306_write_data(ssd1306_device, kbuf, count);
-    kfree(kbuf);
+    if (!(file->f_flags & O_NONBLOCK)) {
+        ret = ssd1306_wait_flush(dev, seq);
+        if (ret < 0)
+            return ret;
+    }
 
     return count;
 }
 
+static long ssd1306_ioctl(struct file *file, unsigned int cmd,
+                          unsigned long arg)
+{
+    struct ssd1306_file *f = file->private_data;
+    struct ssd1306_dev *dev = f->dev;
+    struct ssd1306_rect r;
+    struct ssd1306_area a;
+    struct ssd1306_cmds c;
+    struct ssd1306_vscroll v;
+    struct ssd1306_hscroll h;
+    __u32 fps;
+
+    if (READ_ONCE(dev->dead))
+        return -ENODEV;
+
+    switch (cmd) {
+    case SSD1306_IOC_FLUSH:
+        return ssd1306_queue_frame(dev, file, &ssd1306_full_area);
+
+    case SSD1306_IOC_FLUSH_RECT:
+        if (copy_from_user(&r, (void __user *)arg, sizeof(r)))
+            return -EFAULT;
+        if (!r.width || !r.height)
+            return 0;
+        if (r.x >= SSD1306_FB_WIDTH || r.y >= SSD1306_FB_HEIGHT)
+            return -EINVAL;
+
+        a.c0 = r.x;
+        a.c1 = min_t(int, r.x + r.width, SSD1306_FB_WIDTH) - 1;
+        a.p0 = r.y / 8;
+        a.p1 = (min_t(int, r.y + r.height, SSD1306_FB_HEIGHT) - 1) / 8;
+        return ssd1306_queue_frame(dev, file, &a);
+
+    case SSD1306_IOC_CMDS:
+        if (copy_from_user(&c, (void __user *)arg, sizeof(c)))
+            return -EFAULT;
+        return ssd1306_run_cmds(dev, &c);
+
+    case SSD1306_IOC_VSCROLL:
+        if (copy_from_user(&v, (void __user *)arg, sizeof(v)))
+            return -EFAULT;
+        return ssd1306_vscroll(dev, &v);
+
+    case SSD1306_IOC_HSCROLL_START:
+        if (copy_from_user(&h, (void __user *)arg, sizeof(h)))
+            return -EFAULT;
+        return ssd1306_hscroll_start(dev, &h);
+
+    case SSD1306_IOC_HSCROLL_STOP:
+        return ssd1306_hscroll_stop(dev);
+
+    case SSD1306_IOC_SET_FPS:
+        if (get_user(fps, (__u32 __user *)arg))
+            return -EFAULT;
+        return ssd1306_set_fps(dev, fps);
+    }
+
+    return -ENOTTY;
+}
+
+/*
+ * read() returns one struct ssd1306_frame_event for the newest frame
+ * that reached the panel since this file last read, blocking unless
+ * O_NONBLOCK. Frames merged by the governor produce no event.
+ */
+static ssize_t ssd1306_read(struct file *file, char __user *buf,
+                            size_t count, loff_t *ppos)
+{
+    struct ssd1306_file *f = file->private_data;
+    struct ssd1306_dev *dev = f->dev;
+    struct ssd1306_frame_event ev = { 0 };
+    int ret;
+
+    if (count < sizeof(ev))
+        return -EINVAL;
+
+    if (!ssd1306_flushed(dev, f->seen_seq + 1)) {
+        if (file->f_flags & O_NONBLOCK)
+            return READ_ONCE(dev->dead) ? -ENODEV : -EAGAIN;
+        ret = wait_event_interruptible(dev->flush_wq,
+                                       ssd1306_flushed(dev, f->seen_seq + 1) ||
+                                       READ_ONCE(dev->dead));
+        if (ret)
+            return ret;
+        if (!ssd1306_flushed(dev, f->seen_seq + 1))
+            return -ENODEV;
+    }
+
+    mutex_lock(&dev->fb_lock);
+    ev.seq = dev->flush_seq;
+    ev.timestamp_ns = dev->flush_ts_ns;
+    ev.status = dev->flush_err;
+    mutex_unlock(&dev->fb_lock);
+
+    if (copy_to_user(buf, &ev, sizeof(ev)))
+        return -EFAULT;
+
+    f->seen_seq = ev.seq;
+    return sizeof(ev);
+}
+
+/* fsync() waits for every frame submitted so far to reach the panel */
+static int ssd1306_fsync(struct file *file, loff_t start, loff_t end,
+                         int datasync)
+{
+    struct ssd1306_file *f = file->private_data;
+    struct ssd1306_dev *dev = f->dev;
+    u64 seq;
+
+    mutex_lock(&dev->fb_lock);
+    seq = dev->submit_seq;
+    mutex_unlock(&dev->fb_lock);
+
+    return ssd1306_wait_flush(dev, seq);
+}
+
+/*
+ * POLLIN: a frame-done event is waiting for read().
+ * POLLOUT: no submitted frame is waiting for the bus.
+ */
+static __poll_t ssd1306_poll(struct file *file, poll_table *wait)
+{
+    struct ssd1306_file *f = file->private_data;
+    struct ssd1306_dev *dev = f->dev;
+    __poll_t mask = 0;
+
+    poll_wait(file, &dev->flush_wq, wait);
+    if (READ_ONCE(dev->dead))
+        return EPOLLERR | EPOLLHUP;
+    if (ssd1306_flushed(dev, f->seen_seq + 1))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (ssd1306_flushed(dev, READ_ONCE(dev->submit_seq)))
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    return mask;
+}
+
+/* Map the framebuffer page; userspace draws into it and calls FLUSH */
+static int ssd1306_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct ssd1306_file *f = file->private_data;
+    struct ssd1306_dev *dev = f->dev;
+    unsigned long size = vma->vm_end - vma->vm_start;
+
+    if (READ_ONCE(dev->dead))
+        return -ENODEV;
+    if (vma->vm_pgoff || size > PAGE_SIZE)
+        return -EINVAL;
+
+    return remap_pfn_range(vma, vma->vm_start,
+                           virt_to_phys(dev->fb) >> PAGE_SHIFT,
+                           size, vma->vm_page_prot);
+}
+
 static struct file_operations fops = {
-    .owner   = THIS_MODULE,
-    .open    = ssd1306_open,
-    .release = ssd1306_release,
-    .write   = ssd1306_write,
+    .owner          = THIS_MODULE,
+    .open           = ssd1306_open,
+    .release        = ssd1306_release,
+    .read           = ssd1306_read,
+    .write          = ssd1306_write,
+    .unlocked_ioctl = ssd1306_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+    .mmap           = ssd1306_mmap,
+    .fsync          = ssd1306_fsync,
+    .poll           = ssd1306_poll,
 };
 
-/* ================= I2C Probe ================= */
+/* ================= fbdev ================= */
 
-static int ssd1306_probe(struct i2c_client *client,
-                         const struct i2c_device_id *id)
+#ifdef CONFIG_FB_DEFERRED_IO
+
+/*
+ * fbdev memory is a row-major 1bpp bitmap (LSB = leftmost pixel, same as
+ * ssd1307fb). Pages p0..p1 are converted into the GRAM-layout framebuffer
+ * and queued like any other frame, so the shadow diff still decides what
+ * reaches the bus. The fbdev and the char device share one framebuffer;
+ * the last writer wins.
+ */
+static void ssd1306_fb_update(struct ssd1306_dev *dev, int p0, int p1)
 {
-    struct ssd1306_dev *dev;
+    const u8 *vmem = dev->info->screen_buffer;
+    struct ssd1306_area a = { 0, SSD1306_WIDTH - 1, p0, p1 };
+    int page, x, k;
 
-    dev_info(&client->dev, "SSD1306 I2C OLED Probed\n");
+    mutex_lock(&dev->fb_lock);
+    for (page = p0; page <= p1; page++) {
+        for (x = 0; x < SSD1306_WIDTH; x++) {
+            u8 data = 0;
 
-    dev = devm_kzalloc(&client->dev, sizeof(*dev), GFP_KERNEL);
-    if (!dev)
+            for (k = 0; k < 8; k++) {
+                const u8 *row = &vmem[(page * 8 + k) * SSD1306_FB_LINE_LENGTH];
+
+                if ((row[x / 8] >> (x % 8)) & 1)
+                    data |= BIT(k);
+            }
+            dev->fb[page * SSD1306_WIDTH + x] = data;
+        }
+    }
+    ssd1306_submit(dev, &a);
+    mutex_unlock(&dev->fb_lock);
+}
+
+/* Turn the list of pages touched through mmap into a range of GRAM pages */
+static void ssd1306_fb_deferred_io(struct fb_info *info,
+                                   struct list_head *pagereflist)
+{
+    struct ssd1306_dev *dev = info->par;
+    struct fb_deferred_io_pageref *pageref;
+    unsigned long start = ULONG_MAX, end = 0;
+    int p0, p1;
+
+    list_for_each_entry(pageref, pagereflist, list) {
+        start = min(start, pageref->offset);
+        end = max(end, pageref->offset + PAGE_SIZE);
+    }
+
+    if (start >= end) {
+        /* Kicked by fb_write/fillrect/...: no page list, take it all */
+        p0 = 0;
+        p1 = SSD1306_PAGES - 1;
+    } else {
+        end = min_t(unsigned long, end, info->fix.smem_len);
+        p0 = start / SSD1306_FB_LINE_LENGTH / 8;
+        p1 = (end - 1) / SSD1306_FB_LINE_LENGTH / 8;
+    }
+
+    ssd1306_fb_update(dev, p0, p1);
+}
+
+/* Drawing from the kernel side is batched through the same delay */
+static void ssd1306_fb_kick(struct fb_info *info)
+{
+    schedule_delayed_work(&info->deferred_work, info->fbdefio->delay);
+}
+
+static ssize_t ssd1306_fb_write(struct fb_info *info, const char __user *buf,
+                                size_t count, loff_t *ppos)
+{
+    ssize_t ret = fb_sys_write(info, buf, count, ppos);
+
+    if (ret > 0)
+        ssd1306_fb_kick(info);
+    return ret;
+}
+
+static void ssd1306_fb_fillrect(struct fb_info *info,
+                                const struct fb_fillrect *rect)
+{
+    sys_fillrect(info, rect);
+    ssd1306_fb_kick(info);
+}
+
+static void ssd1306_fb_copyarea(struct fb_info *info,
+                                const struct fb_copyarea *area)
+{
+    sys_copyarea(info, area);
+    ssd1306_fb_kick(info);
+}
+
+static void ssd1306_fb_imageblit(struct fb_info *info,
+                                 const struct fb_image *image)
+{
+    sys_imageblit(info, image);
+    ssd1306_fb_kick(info);
+}
+
+static int ssd1306_fb_blank(int blank_mode, struct fb_info *info)
+{
+    struct ssd1306_dev *dev = info->par;
+    int ret;
+
+    mutex_lock(&dev->lock);
+    ret = ssd1306_write_cmd(dev, blank_mode == FB_BLANK_UNBLANK ?
+                            SSD1306_DISPLAYON : SSD1306_DISPLAYOFF);
+    mutex_unlock(&dev->lock);
+
+    return ret < 0 ? ret : 0;
+}
+
+static const struct fb_ops ssd1306_fb_ops = {
+    .owner        = THIS_MODULE,
+    .fb_read      = fb_sys_read,
+    .fb_write     = ssd1306_fb_write,
+    .fb_blank     = ssd1306_fb_blank,
+    .fb_fillrect  = ssd1306_fb_fillrect,
+    .fb_copyarea  = ssd1306_fb_copyarea,
+    .fb_imageblit = ssd1306_fb_imageblit,
+    .fb_mmap      = fb_deferred_io_mmap,
+};
+
+static int ssd1306_fb_register(struct ssd1306_dev *dev)
+{
+    struct fb_info *info;
+    u8 *vmem;
+    int ret;
+
+    info = framebuffer_alloc(0, dev->parent);
+    if (!info)
         return -ENOMEM;
 
-    dev->client = client;
-    ssd1306_device = dev;
-    i2c_set_clientdata(client, dev);
+    vmem = (u8 *)get_zeroed_page(GFP_KERNEL);
+    if (!vmem) {
+        ret = -ENOMEM;
+        goto err_release;
+    }
+
+    info->par = dev;
+    info->fbops = &ssd1306_fb_ops;
+    info->screen_buffer = vmem;
+
+    dev->defio.delay = SSD1306_FB_DEFIO_DELAY;
+    dev->defio.deferred_io = ssd1306_fb_deferred_io;
+    info->fbdefio = &dev->defio;
+
+    strscpy(info->fix.id, "SSD1306", sizeof(info->fix.id));
+    info->fix.type = FB_TYPE_PACKED_PIXELS;
+    info->fix.visual = FB_VISUAL_MONO10;
+    info->fix.accel = FB_ACCEL_NONE;
+    info->fix.line_length = SSD1306_FB_LINE_LENGTH;
+    info->fix.smem_start = __pa(vmem);
+    info->fix.smem_len = SSD1306_FB_SIZE;
 
-    /* char device */
-    alloc_chrdev_region(&dev->dev_num, 0, 1, DRIVER_NAME);
-    dev->class = class_create(THIS_MODULE, CLASS_NAME);
+    info->var.xres = info->var.xres_virtual = SSD1306_FB_WIDTH;
+    info->var.yres = info->var.yres_virtual = SSD1306_FB_HEIGHT;
+    info->var.bits_per_pixel = 1;
+    info->var.red.length = 1;
+    info->var.green.length = 1;
+    info->var.blue.length = 1;
 
-    cdev_init(&dev->cdev, &fops);
-    cdev_add(&dev->cdev, dev->dev_num, 1);
+    ret = fb_deferred_io_init(info);
+    if (ret)
+        goto err_free_vmem;
 
-    device_create(dev->class, NULL, dev->dev_num, NULL, DRIVER_NAME);
+    ret = register_framebuffer(info);
+    if (ret)
+        goto err_defio;
+
+    dev->info = info;
+    dev_info(dev->parent, "fb%d: SSD1306 framebuffer\n", info->node);
+    return 0;
+
+err_defio:
+    fb_deferred_io_cleanup(info);
+err_free_vmem:
+    free_page((unsigned long)vmem);
+err_release:
+    framebuffer_release(info);
+    return ret;
+}
+
+static void ssd1306_fb_unregister(struct ssd1306_dev *dev)
+{
+    struct fb_info *info = dev->info;
+
+    if (!info)
+        return;
+
+    unregister_framebuffer(info);
+    fb_deferred_io_cleanup(info);
+    free_page((unsigned long)info->screen_buffer);
+    framebuffer_release(info);
+    dev->info = NULL;
+}
+
+#else
+
+static int ssd1306_fb_register(struct ssd1306_dev *dev)
+{
+    dev_warn(dev->parent, "fbdev requested but CONFIG_FB_DEFERRED_IO is off\n");
+    return 0;
+}
+
+static void ssd1306_fb_unregister(struct ssd1306_dev *dev)
+{
+}
+
+#endif /* CONFIG_FB_DEFERRED_IO */
+
+/* ================= Statistics ================= */
+
+/* Upper bound of the bucket holding the pct-th percentile, in us */
+static u64 ssd1306_lat_percentile_us(struct ssd1306_dev *dev, int pct)
+{
+    u64 total = 0, target, acc = 0;
+    int b;
+
+    for (b = 0; b < SSD1306_LAT_BUCKETS; b++)
+        total += dev->lat_hist[b];
+    if (!total)
+        return 0;
+
+    target = DIV_ROUND_UP_ULL(total * pct, 100);
+    for (b = 0; b < SSD1306_LAT_BUCKETS; b++) {
+        acc += dev->lat_hist[b];
+        if (acc >= target)
+            break;
+    }
+    return 1ULL << (min(b, SSD1306_LAT_BUCKETS - 1) + 1);
+}
+
+static int ssd1306_lat_hist_show(struct seq_file *m, void *unused)
+{
+    struct ssd1306_dev *dev = m->private;
+    int b;
+
+    mutex_lock(&dev->lock);
+    seq_printf(m, "%10s %10s\n", "<us", "count");
+    for (b = 0; b < SSD1306_LAT_BUCKETS; b++)
+        seq_printf(m, "%10llu %10llu\n", 1ULL << (b + 1), dev->lat_hist[b]);
+    mutex_unlock(&dev->lock);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ssd1306_lat_hist);
+
+static void ssd1306_debugfs_init(struct ssd1306_dev *dev)
+{
+    dev->debugfs = debugfs_create_dir(dev_name(dev->parent),
+                                      ssd1306_debugfs_root);
+    debugfs_create_file("latency_hist", 0444, dev->debugfs, dev,
+                        &ssd1306_lat_hist_fops);
+}
+
+/* ================= sysfs ================= */
+
+#define SSD1306_STAT_ATTR(_name, _expr)                                   \
+static ssize_t _name##_show(struct device *d,                             \
+                            struct device_attribute *attr, char *buf)     \
+{                                                                         \
+    struct ssd1306_dev *dev = dev_get_drvdata(d);                         \
+                                                                          \
+    return sysfs_emit(buf, "%llu\n", (unsigned long long)(_expr));        \
+}                                                                         \
+static DEVICE_ATTR_RO(_name)
+
+SSD1306_STAT_ATTR(frames_submitted, READ_ONCE(dev->submit_seq));
+SSD1306_STAT_ATTR(frames_flushed, READ_ONCE(dev->frames_flushed));
+SSD1306_STAT_ATTR(frames_dropped, READ_ONCE(dev->frames_dropped));
+SSD1306_STAT_ATTR(tx_bytes, READ_ONCE(dev->tx_bytes));
+SSD1306_STAT_ATTR(xfers, READ_ONCE(dev->xfers));
+SSD1306_STAT_ATTR(xfer_errors, READ_ONCE(dev->xfer_errors));
+SSD1306_STAT_ATTR(xfer_latency_min_us,
+                  READ_ONCE(dev->lat_min_ns) / NSEC_PER_USEC);
+SSD1306_STAT_ATTR(xfer_latency_max_us,
+                  READ_ONCE(dev->lat_max_ns) / NSEC_PER_USEC);
+
+static ssize_t xfer_latency_avg_us_show(struct device *d,
+                                        struct device_attribute *attr,
+                                        char *buf)
+{
+    struct ssd1306_dev *dev = dev_get_drvdata(d);
+    u64 sum, n;
+
+    mutex_lock(&dev->lock);
+    sum = dev->lat_sum_ns;
+    n = dev->xfers - dev->xfer_errors;
+    mutex_unlock(&dev->lock);
+
+    return sysfs_emit(buf, "%llu\n", n ? div64_u64(sum, n) / NSEC_PER_USEC : 0);
+}
+static DEVICE_ATTR_RO(xfer_latency_avg_us);
+
+/* Histogram based, so this is the upper edge of a power-of-two bucket */
+static ssize_t xfer_latency_p99_us_show(struct device *d,
+                                        struct device_attribute *attr,
+                                        char *buf)
+{
+    struct ssd1306_dev *dev = dev_get_drvdata(d);
+    u64 p99;
+
+    mutex_lock(&dev->lock);
+    p99 = ssd1306_lat_percentile_us(dev, 99);
+    mutex_unlock(&dev->lock);
+
+    return sysfs_emit(buf, "%llu\n", p99);
+}
+static DEVICE_ATTR_RO(xfer_latency_p99_us);
+
+/*
+ * Milliseconds since a frame was last written to the panel without
+ * error, -1 if never. Failed and empty runs do not count, so a stalled
+ * or failing bus shows up as a growing age.
+ */
+static ssize_t last_flush_age_ms_show(struct device *d,
+                                      struct device_attribute *attr,
+                                      char *buf)
+{
+    struct ssd1306_dev *dev = dev_get_drvdata(d);
+    u64 ts = READ_ONCE(dev->last_ok_ns);
+
+    if (!ts)
+        return sysfs_emit(buf, "-1\n");
+    return sysfs_emit(buf, "%llu\n",
+                      div_u64(ktime_get_ns() - ts, NSEC_PER_MSEC));
+}
+static DEVICE_ATTR_RO(last_flush_age_ms);
+
+static ssize_t max_fps_show(struct device *d,
+                            struct device_attribute *attr, char *buf)
+{
+    struct ssd1306_dev *dev = dev_get_drvdata(d);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(dev->max_fps));
+}
+
+static ssize_t max_fps_store(struct device *d, struct device_attribute *attr,
+                             const char *buf, size_t count)
+{
+    struct ssd1306_dev *dev = dev_get_drvdata(d);
+    unsigned int fps;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &fps);
+    if (ret)
+        return ret;
+
+    ret = ssd1306_set_fps(dev, fps);
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(max_fps);
+
+static struct attribute *ssd1306_attrs[] = {
+    &dev_attr_max_fps.attr,
+    &dev_attr_frames_submitted.attr,
+    &dev_attr_frames_flushed.attr,
+    &dev_attr_frames_dropped.attr,
+    &dev_attr_tx_bytes.attr,
+    &dev_attr_xfers.attr,
+    &dev_attr_xfer_errors.attr,
+    &dev_attr_xfer_latency_min_us.attr,
+    &dev_attr_xfer_latency_avg_us.attr,
+    &dev_attr_xfer_latency_p99_us.attr,
+    &dev_attr_xfer_latency_max_us.attr,
+    &dev_attr_last_flush_age_ms.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(ssd1306);
+
+/* ================= Probe ================= */
+
+/*
+ * Bus independent part of probe; the caller filled in the transport.
+ * On error the caller drops its reference, which frees fb.
+ */
+static int ssd1306_probe_common(struct ssd1306_dev *dev)
+{
+    struct device *cdev_dev;
+    int ret;
+
+    mutex_init(&dev->lock);
+    mutex_init(&dev->fb_lock);
+    dev->pending = dev->xfer[0];
+    dev->frame = dev->xfer[1];
+    ssd1306_area_clear(&dev->dirty);
+    INIT_DELAYED_WORK(&dev->flush_work, ssd1306_flush_work);
+    dev->max_fps = min_t(unsigned int, max_fps, SSD1306_MAX_FPS);
+    init_waitqueue_head(&dev->flush_wq);
+
+    dev->fb = (u8 *)get_zeroed_page(GFP_KERNEL);
+    if (!dev->fb)
+        return -ENOMEM;
+
+    dev->tx_buf[0] = 0x40;
+
+    /* Reserve the minor; open() finds dev only once probe is done */
+    mutex_lock(&ssd1306_idr_lock);
+    dev->id = idr_alloc(&ssd1306_idr, NULL, 0, SSD1306_MAX_DEVICES,
+                        GFP_KERNEL);
+    mutex_unlock(&ssd1306_idr_lock);
+    if (dev->id < 0)
+        return dev->id;
+
+    /*
+     * char device: first panel keeps the old node name. The cdev is
+     * allocated on its own because open files keep it past remove.
+     */
+    dev->dev_num = MKDEV(MAJOR(ssd1306_devt), dev->id);
+    dev->cdev = cdev_alloc();
+    if (!dev->cdev) {
+        ret = -ENOMEM;
+        goto err_free_id;
+    }
+    dev->cdev->owner = THIS_MODULE;
+    dev->cdev->ops = &fops;
+    ret = cdev_add(dev->cdev, dev->dev_num, 1);
+    if (ret)
+        goto err_del_cdev;
+
+    if (dev->id)
+        cdev_dev = device_create_with_groups(ssd1306_class, dev->parent,
+                                             dev->dev_num, dev,
+                                             ssd1306_groups, "%s%d",
+                                             DRIVER_NAME, dev->id);
+    else
+        cdev_dev = device_create_with_groups(ssd1306_class, dev->parent,
+                                             dev->dev_num, dev,
+                                             ssd1306_groups, DRIVER_NAME);
+    if (IS_ERR(cdev_dev)) {
+        ret = PTR_ERR(cdev_dev);
+        goto err_del_cdev;
+    }
 
     /* OLED init */
-    ssd1306_init_seq(dev);
+    mutex_lock(&dev->lock);
+    ret = ssd1306_init_seq(dev);
+    mutex_unlock(&dev->lock);
+    if (ret < 0)
+        dev_warn(dev->parent, "init sequence failed: %d\n", ret);
+
+    ssd1306_debugfs_init(dev);
+
+    if (fbdev) {
+        ret = ssd1306_fb_register(dev);
+        if (ret)
+            dev_warn(dev->parent, "fbdev registration failed: %d\n", ret);
+    }
 
-    dev_info(&client->dev, "SSD1306 Initialized (I2C, 4-pin)\n");
+    mutex_lock(&ssd1306_idr_lock);
+    idr_replace(&ssd1306_idr, dev, dev->id);
+    mutex_unlock(&ssd1306_idr_lock);
+
+    dev_info(dev->parent, "SSD1306 #%d Initialized (%s)\n",
+             dev->id, dev->tr->name);
     return 0;
+
+err_del_cdev:
+    cdev_del(dev->cdev);
+err_free_id:
+    mutex_lock(&ssd1306_idr_lock);
+    idr_remove(&ssd1306_idr, dev->id);
+    mutex_unlock(&ssd1306_idr_lock);
+    return ret;
 }
 
-static void ssd1306_remove(struct i2c_client *client)
+/*
+ * Files may still be open (and fb mapped): they keep dev until their
+ * release, but every operation now fails with ENODEV and nothing
+ * touches the bus device after this returns.
+ */
+static void ssd1306_remove_common(struct ssd1306_dev *dev)
 {
-    struct ssd1306_dev *dev = i2c_get_clientdata(client);
+    mutex_lock(&ssd1306_idr_lock);
+    idr_remove(&ssd1306_idr, dev->id);
+    mutex_unlock(&ssd1306_idr_lock);
+
+    ssd1306_fb_unregister(dev);
+    debugfs_remove_recursive(dev->debugfs);
 
+    mutex_lock(&dev->lock);
     ssd1306_write_cmd(dev, SSD1306_DISPLAYOFF);
+    mutex_lock(&dev->fb_lock);
+    dev->dead = true;
+    mutex_unlock(&dev->fb_lock);
+    mutex_unlock(&dev->lock);
+
+    /* No new kicks from here on; wake writers, readers and pollers */
+    wake_up_interruptible_all(&dev->flush_wq);
+    cancel_delayed_work_sync(&dev->flush_work);
+
+    device_destroy(ssd1306_class, dev->dev_num);
+    cdev_del(dev->cdev);
 
-    device_destroy(dev->class, dev->dev_num);
-    cdev_del(&dev->cdev);
-    class_destroy(dev->class);
-    unregister_chrdev_region(dev->dev_num, 1);
+    ssd1306_dev_put(dev);
 }
 
 /* ================= I2C Driver ================= */
 
+static int ssd1306_probe(struct i2c_client *client,
+                         const struct i2c_device_id *id)
+{
+    struct ssd1306_dev *dev;
+    int ret;
+
+    dev_info(&client->dev, "SSD1306 I2C OLED Probed\n");
+
+    /*
+     * All transfer buffers live in dev; nothing is allocated per frame.
+     * Not devm: open files hold dev past unbind.
+     */
+    dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+    if (!dev)
+        return -ENOMEM;
+    kref_init(&dev->ref);
+
+    dev->parent = &client->dev;
+    dev->tr = &ssd1306_i2c_transport;
+    dev->client = client;
+    i2c_set_clientdata(client, dev);
+
+    ret = ssd1306_probe_common(dev);
+    if (ret)
+        ssd1306_dev_put(dev);
+    return ret;
+}
+
+static void ssd1306_remove(struct i2c_client *client)
+{
+    ssd1306_remove_common(i2c_get_clientdata(client));
+}
+
 static const struct i2c_device_id ssd1306_id[] = {
     { "ssd1306", 0 },
     { }
@@ -218,10 +1556,159 @@ static struct i2c_driver ssd1306_driver = {
     .id_table = ssd1306_id,
 };
 
-module_i2c_driver(ssd1306_driver);
+/* ================= SPI Driver ================= */
 
-MODULE_LICENSE("GPL");
-MODULE_AUTHOR("you");
-MODULE_DESCRIPTION("SSD1306 I2C OLED Driver (4-pin)");
+#if IS_ENABLED(CONFIG_SPI_MASTER)
+
+/*
+ * 4-wire SPI panel: "dc-gpios" is required, "reset-gpios" optional.
+ * Without spi-max-frequency the bus runs at SSD1306_SPI_DEFAULT_HZ.
+ */
+static int ssd1306_spi_probe(struct spi_device *spi)
+{
+    struct ssd1306_dev *dev;
+    int ret;
+
+    dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+    if (!dev)
+        return -ENOMEM;
+    kref_init(&dev->ref);
 
+    dev->dc = devm_gpiod_get(&spi->dev, "dc", GPIOD_OUT_LOW);
+    if (IS_ERR(dev->dc)) {
+        ret = dev_err_probe(&spi->dev, PTR_ERR(dev->dc), "no dc gpio\n");
+        goto err_put;
+    }
+
+    dev->reset = devm_gpiod_get_optional(&spi->dev, "reset", GPIOD_OUT_HIGH);
+    if (IS_ERR(dev->reset)) {
+        ret = PTR_ERR(dev->reset);
+        goto err_put;
+    }
+    if (dev->reset) {
+        /* RES# low for >= 3 us */
+        usleep_range(10, 20);
+        gpiod_set_value_cansleep(dev->reset, 0);
+        usleep_range(10, 20);
+    }
+
+    if (!spi->max_speed_hz)
+        spi->max_speed_hz = SSD1306_SPI_DEFAULT_HZ;
+    ret = spi_setup(spi);
+    if (ret)
+        goto err_put;
+
+    dev->parent = &spi->dev;
+    dev->tr = &ssd1306_spi_transport;
+    dev->spi = spi;
+    spi_set_drvdata(spi, dev);
+
+    ret = ssd1306_probe_common(dev);
+    if (ret)
+        goto err_put;
+    return 0;
+
+err_put:
+    ssd1306_dev_put(dev);
+    return ret;
+}
+
+static void ssd1306_spi_remove(struct spi_device *spi)
+{
+    ssd1306_remove_common(spi_get_drvdata(spi));
+}
+
+static const struct spi_device_id ssd1306_spi_id[] = {
+    { "ssd1306", 0 },
+    { }
+};
+MODULE_DEVICE_TABLE(spi, ssd1306_spi_id);
+
+static const struct of_device_id ssd1306_spi_of_match[] = {
+    { .compatible = "solomon,ssd1306" },
+    { }
+};
+MODULE_DEVICE_TABLE(of, ssd1306_spi_of_match);
+
+static struct spi_driver ssd1306_spi_driver = {
+    .driver = {
+        .name           = DRIVER_NAME,
+        .of_match_table = ssd1306_spi_of_match,
+    },
+    .probe    = ssd1306_spi_probe,
+    .remove   = ssd1306_spi_remove,
+    .id_table = ssd1306_spi_id,
+};
+
+static int ssd1306_spi_register(void)
+{
+    return spi_register_driver(&ssd1306_spi_driver);
+}
 
+static void ssd1306_spi_unregister(void)
+{
+    spi_unregister_driver(&ssd1306_spi_driver);
+}
+
+#else
+
+static int ssd1306_spi_register(void) { return 0; }
+static void ssd1306_spi_unregister(void) { }
+
+#endif /* CONFIG_SPI_MASTER */
+
+/* ================= Module ================= */
+
+static int __init ssd1306_init(void)
+{
+    int ret;
+
+    ret = alloc_chrdev_region(&ssd1306_devt, 0, SSD1306_MAX_DEVICES,
+                              DRIVER_NAME);
+    if (ret)
+        return ret;
+
+    ssd1306_class = class_create(THIS_MODULE, CLASS_NAME);
+    if (IS_ERR(ssd1306_class)) {
+        ret = PTR_ERR(ssd1306_class);
+        goto err_region;
+    }
+
+    ssd1306_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
+
+    ret = i2c_add_driver(&ssd1306_driver);
+    if (ret)
+        goto err_class;
+
+    ret = ssd1306_spi_register();
+    if (ret)
+        goto err_i2c;
+
+    return 0;
+
+err_i2c:
+    i2c_del_driver(&ssd1306_driver);
+err_class:
+    debugfs_remove_recursive(ssd1306_debugfs_root);
+    class_destroy(ssd1306_class);
+err_region:
+    unregister_chrdev_region(ssd1306_devt, SSD1306_MAX_DEVICES);
+    return ret;
+}
+
+static void __exit ssd1306_exit(void)
+{
+    ssd1306_spi_unregister();
+    i2c_del_driver(&ssd1306_driver);
+    debugfs_remove_recursive(ssd1306_debugfs_root);
+    class_destroy(ssd1306_class);
+    unregister_chrdev_region(ssd1306_devt, SSD1306_MAX_DEVICES);
+    idr_destroy(&ssd1306_idr);
+}
+
+module_init(ssd1306_init);
+module_exit(ssd1306_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("you");
+MODULE_DESCRIPTION("SSD1306 OLED Driver (I2C / 4-wire SPI)");
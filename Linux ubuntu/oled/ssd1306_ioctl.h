@@ -0,0 +1,101 @@
+/*
+ * ssd1306_ioctl.h - userspace interface of /dev/ssd1306_driver[N]
+ *
+ * Shared by the kernel module and applications (main1.c).
+ */
+#ifndef SSD1306_IOCTL_H
+#define SSD1306_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define SSD1306_FB_WIDTH   128
+#define SSD1306_FB_HEIGHT  64
+#define SSD1306_FB_SIZE    (SSD1306_FB_WIDTH * SSD1306_FB_HEIGHT / 8)
+
+/*
+ * Framebuffer layout (mmap offset 0, SSD1306_FB_SIZE bytes):
+ * byte[x + (y / 8) * 128], bit (y % 8) -- same as the panel GRAM.
+ */
+
+/* Dirty rectangle in pixels */
+struct ssd1306_rect {
+    __u16 x;
+    __u16 y;
+    __u16 width;
+    __u16 height;
+};
+
+/*
+ * Raw command batch, sent behind a single 0x00 control byte in one
+ * transaction, e.g. { 3, { 0x81, 0x40, 0xA7 } } = contrast 0x40 + invert.
+ * Two bytes are reserved for the driver to restore addressing mode.
+ * Only documented SSD1306 opcodes are accepted. Scroll commands
+ * (0x26/0x27/0x29/0x2A/0x2E/0x2F; use the HSCROLL ioctls), unknown
+ * opcodes and batches ending in the middle of a command's arguments
+ * fail with EINVAL.
+ */
+#define SSD1306_MAX_CMDS   32
+
+struct ssd1306_cmds {
+    __u8 len;
+    __u8 cmds[SSD1306_MAX_CMDS - 2];
+};
+
+/*
+ * Vertical scroll: the panel starts scanning GRAM at start_line (0..63),
+ * shifted by display_offset (0..63). Scrolling by one text row is then
+ * this ioctl plus drawing the newly exposed row into the framebuffer at
+ * its GRAM position and flushing -- only that row goes over the bus.
+ */
+struct ssd1306_vscroll {
+    __u8 start_line;
+    __u8 display_offset;
+};
+
+#define SSD1306_HSCROLL_RIGHT  0
+#define SSD1306_HSCROLL_LEFT   1
+
+/*
+ * Continuous hardware horizontal scroll of pages start_page..end_page.
+ * interval is the panel's 3-bit step code (0 = 5 frames ... 7 = 2 frames).
+ * The panel does not allow GRAM writes while scrolling: frames flushed
+ * in the meantime fail with EBUSY and the latest one is sent when the
+ * scroll is stopped.
+ */
+struct ssd1306_hscroll {
+    __u8 direction;
+    __u8 start_page;
+    __u8 end_page;
+    __u8 interval;
+};
+
+/*
+ * read() on the device returns one of these for the newest frame that
+ * reached the panel since the last read (poll: POLLIN). Frames replaced
+ * before they were sent (frame rate limit, busy bus) produce no event.
+ */
+struct ssd1306_frame_event {
+    __u64 seq;           /* frame sequence number */
+    __u64 timestamp_ns;  /* CLOCK_MONOTONIC time the transfer finished */
+    __s32 status;        /* 0 or -errno of the transfer */
+    __u32 reserved;
+};
+
+#define SSD1306_IOC_MAGIC       'S'
+
+/* Push the whole mmap'ed framebuffer to the panel */
+#define SSD1306_IOC_FLUSH       _IO(SSD1306_IOC_MAGIC, 0)
+/* Push only the given rectangle of the framebuffer */
+#define SSD1306_IOC_FLUSH_RECT  _IOW(SSD1306_IOC_MAGIC, 1, struct ssd1306_rect)
+/* Send a batched command list */
+#define SSD1306_IOC_CMDS        _IOW(SSD1306_IOC_MAGIC, 2, struct ssd1306_cmds)
+/* Set start line / display offset */
+#define SSD1306_IOC_VSCROLL     _IOW(SSD1306_IOC_MAGIC, 3, struct ssd1306_vscroll)
+/* Start / stop hardware horizontal scroll */
+#define SSD1306_IOC_HSCROLL_START _IOW(SSD1306_IOC_MAGIC, 4, struct ssd1306_hscroll)
+#define SSD1306_IOC_HSCROLL_STOP  _IO(SSD1306_IOC_MAGIC, 5)
+/* Frame rate limit in frames/s (__u32), 0 = unlimited */
+#define SSD1306_IOC_SET_FPS     _IOW(SSD1306_IOC_MAGIC, 6, __u32)
+
+#endif /* SSD1306_IOCTL_H */
@@ -4,9 +4,14 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/select.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
 #include <time.h>
 #include <errno.h>
 #include "font_header.h"
+#include "ssd1306_ioctl.h"
+#include "rotary_ioctl.h"
+#include "ds1302_ioctl.h"
 
 #define DEV_OLED    "/dev/ssd1306_driver"
 #define DEV_ROTARY  "/dev/rotary_device_driver"
@@ -14,7 +19,7 @@
 
 #define SCREEN_W 128
 #define SCREEN_H 64
-static unsigned char fb[1024];
+static unsigned char *fb;   /* 드라이버 프레임버퍼 (mmap) */
 
 typedef enum { STATE_MENU, STATE_CLOCK, STATE_WORLD, STATE_GAME } AppState;
 typedef enum { CLOCK_VIEW, CLOCK_EDIT } ClockMode;
@@ -33,12 +38,12 @@ static int  menu_index = 0;
 static int  menu_acc = 0;
 static const char *menu_items[] = {"CLOCK", "WORLD", "GAME"};
 
-static struct timespec press_start;
+static unsigned long long press_start_ns;
 static int is_holding = 0;
+static int synced = 0;
 
 /* RTC 캐시 */
 static char rtc_cache[32] = "2000-01-01 00:00:00";
-static struct timespec last_rtc_poll = {0};
 
 /* CLOCK 수정 */
 static int edit_year, edit_mon, edit_day, edit_hour, edit_min, edit_sec;
@@ -70,22 +75,8 @@ static int score = 0;
 static int game_over = 0;
 
 /* ========== 유틸 ========== */
-static long diff_ms(struct timespec a, struct timespec b) {
-    long sec  = a.tv_sec - b.tv_sec;
-    long nsec = a.tv_nsec - b.tv_nsec;
-    return sec * 1000 + nsec / 1000000;
-}
-
-static void poll_rtc_if_due(int period_ms) {
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-
-    int first = (last_rtc_poll.tv_sec == 0 && last_rtc_poll.tv_nsec == 0);
-    if (!first) {
-        if (diff_ms(now, last_rtc_poll) < period_ms) return;
-    }
-    last_rtc_poll = now;
-
+/* fd_rtc가 readable(새 초)일 때만 호출: 드라이버 캐시라 버스 접근 없음 */
+static void read_rtc(void) {
     char tmp[64] = {0};
 
     int n = pread(fd_rtc, tmp, sizeof(tmp) - 1, 0);
@@ -99,6 +90,41 @@ static void poll_rtc_if_due(int period_ms) {
     rtc_cache[sizeof(rtc_cache) - 1] = '\0';
 }
 
+static unsigned char to_bcd(int v) { return (unsigned char)(((v / 10) << 4) | (v % 10)); }
+
+/* 드라이버가 그 달에 없는 날짜(2월 31일 등)는 EINVAL로 거절하므로 미리 맞춤 */
+static int month_days(int year, int mon)
+{
+    static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    if (mon == 2 && year % 4 == 0) return 29; // 2000~2099
+    return days[mon - 1];
+}
+
+/*
+ * DS1302 배터리 백업 RAM에 UI 상태 보관 (SD 카드 쓰기 없이 burst 한 번)
+ * data[0]: 매직, data[1]: 메뉴 커서, data[2]: WORLD 도시
+ */
+#define UI_RAM_MAGIC 0xA5
+
+static void ui_state_load(void) {
+    struct ds1302_ram ram;
+
+    if (ioctl(fd_rtc, DS1302_IOC_RAM_READ, &ram) < 0 || ram.data[0] != UI_RAM_MAGIC)
+        return;
+    if (ram.data[1] < 3)          menu_index = ram.data[1];
+    if (ram.data[2] < CITY_COUNT) world_city = ram.data[2];
+}
+
+static void ui_state_save(void) {
+    struct ds1302_ram ram = {0};
+
+    ram.data[0] = UI_RAM_MAGIC;
+    ram.data[1] = (unsigned char)menu_index;
+    ram.data[2] = (unsigned char)world_city;
+    ioctl(fd_rtc, DS1302_IOC_RAM_WRITE, &ram);
+}
+
 /* ========== 그래픽 ========== */
 static void draw_pixel(int x, int y, int color) {
     if (x < 0 || x >= 128 || y < 0 || y >= 64) return;
@@ -283,9 +309,107 @@ static void handle_game(void) {
     draw_str(0, 0, sbuf);
 }
 
+/* ========== 입력 ========== */
+/* 로터리 이벤트 한 건 처리 (val: 누적값, btn: 1 뗌/0 누름, ts_ns: 커널 IRQ 시각) */
+static void handle_rotary_event(long val, int btn, unsigned long long ts_ns) {
+    rotary_val = val;
+
+    if (!synced) {
+        last_rotary_val = rotary_val;
+        synced = 1;
+    }
+
+    rotary_delta += rotary_val - last_rotary_val;
+    last_rotary_val = rotary_val;
+
+    if (btn == 0) { // press
+        if (!is_holding) {
+            press_start_ns = ts_ns;
+            is_holding = 1;
+        }
+    } else { // release
+        if (is_holding) {
+            /* 누름/뗌 모두 커널 IRQ 시각 기준 */
+            unsigned long long held_ms = (ts_ns - press_start_ns) / 1000000ULL;
+
+            if (held_ms >= 2000) {
+                /* ===== 2초 홀드 ===== */
+                if (current_state == STATE_CLOCK) {
+                    if (clock_mode == CLOCK_VIEW) {
+                        /* 수정 모드 진입 */
+                        int y,m,d,hh,mm,ss;
+                        if (sscanf(rtc_cache, "%d-%d-%d %d:%d:%d",
+                                   &y,&m,&d,&hh,&mm,&ss) == 6) {
+                            edit_year = y;
+                            edit_mon  = m;
+                            edit_day  = d;
+                            edit_hour = hh;
+                            edit_min  = mm;
+                            edit_sec  = ss;
+                        } else {
+                            edit_year=2000; edit_mon=1; edit_day=1;
+                            edit_hour=0; edit_min=0; edit_sec=0;
+                        }
+                        edit_field = 0;
+                        clock_mode = CLOCK_EDIT;
+                    } else {
+                        /* 저장 (레지스터 그대로, BCD) */
+                        struct ds1302_regs regs = {
+                            .sec  = to_bcd(edit_sec),
+                            .min  = to_bcd(edit_min),
+                            .hour = to_bcd(edit_hour),
+                            .mday = to_bcd(edit_day),
+                            .mon  = to_bcd(edit_mon),
+                            .wday = 1,
+                            .year = to_bcd(edit_year % 100),
+                        };
+                        /* 실패하면 수정 모드에 남아 값을 고칠 수 있게 */
+                        if (ioctl(fd_rtc, DS1302_IOC_SET_REGS, &regs) < 0)
+                            perror("RTC Set Failed");
+                        else
+                            clock_mode = CLOCK_VIEW;
+                    }
+                } else if (current_state == STATE_GAME) {
+                    /* GAME: 홀드하면 메뉴 */
+                    current_state = STATE_MENU;
+                } else {
+                    /* MENU/WORLD에서는 홀드 동작 없음 */
+                }
+            } else {
+                /* ===== 짧은 클릭 ===== */
+                if (current_state == STATE_MENU) {
+                    current_state = (AppState)(menu_index + 1);
+                    ui_state_save();
+                }
+                else if (current_state == STATE_CLOCK) {
+                    if (clock_mode == CLOCK_VIEW) {
+                        /* CLOCK VIEW: 나가기 */
+                        current_state = STATE_MENU;
+                    } else {
+                        /* CLOCK EDIT: 다음 필드 */
+                        edit_field = (edit_field + 1) % 6;
+                    }
+                }
+                else if (current_state == STATE_WORLD) {
+                    /* WORLD: 나가기 (보던 도시 기억) */
+                    current_state = STATE_MENU;
+                    ui_state_save();
+                }
+                else if (current_state == STATE_GAME) {
+                    /* GAME OVER면 클릭으로 재시작 */
+                    if (game_over) reset_game();
+                }
+            }
+
+            is_holding = 0;
+        }
+    }
+}
+
 /* ========== 메인 ========== */
 int main(void) {
-    fd_oled = open(DEV_OLED, O_RDWR);
+    /* O_NONBLOCK: FLUSH는 프레임만 넘기고 바로 리턴 (전송은 드라이버 워커가 처리) */
+    fd_oled = open(DEV_OLED, O_RDWR | O_NONBLOCK);
     fd_rot  = open(DEV_ROTARY, O_RDONLY);
     fd_rtc  = open(DEV_RTC, O_RDWR);
 
@@ -294,124 +418,58 @@ int main(void) {
         return -1;
     }
 
+    fb = mmap(NULL, SSD1306_FB_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_oled, 0);
+    if (fb == MAP_FAILED) {
+        perror("OLED mmap Failed");
+        return -1;
+    }
+
+    /* 로터리는 바이너리 레코드로 받음 (텍스트 변환 없음) */
+    __u32 fmt = ROTARY_FMT_BINARY;
+    if (ioctl(fd_rot, ROTARY_IOC_SET_FORMAT, &fmt) < 0) {
+        perror("Rotary Format Failed");
+        return -1;
+    }
+
+    /* 패널 갱신은 30fps로 제한: 그 사이 프레임은 드라이버가 최신 것만 남김 */
+    __u32 fps = 30;
+    ioctl(fd_oled, SSD1306_IOC_SET_FPS, &fps);
+
     srand(time(NULL));
 
     fd_set fds;
     struct timeval tv;
-    int synced = 0;
 
     reset_game();
+    ui_state_load();
 
     while (1) {
         /* 수정중이면 RTC 자동 갱신 멈추고(화면 안정), VIEW일 때만 갱신 */
-        if (!(current_state == STATE_CLOCK && clock_mode == CLOCK_EDIT)) {
-            poll_rtc_if_due(200);
-        }
+        int watch_rtc = !(current_state == STATE_CLOCK && clock_mode == CLOCK_EDIT);
 
-        memset(fb, 0, sizeof(fb));
+        memset(fb, 0, SSD1306_FB_SIZE);
 
-        /* 입력 대기 */
+        /* 입력 대기: 로터리 이벤트 또는 RTC 초 경계 (드라이버가 그 순간에 깨움) */
         FD_ZERO(&fds);
         FD_SET(fd_rot, &fds);
+        if (watch_rtc)
+            FD_SET(fd_rtc, &fds);
         tv.tv_sec  = 0;
         tv.tv_usec = 30000;
 
-        int r = select(fd_rot + 1, &fds, NULL, NULL, &tv);
-
-        if (r > 0 && FD_ISSET(fd_rot, &fds)) {
-            char buf[64] = {0};
-            int btn = 1;
+        int maxfd = fd_rot > fd_rtc ? fd_rot : fd_rtc;
+        int r = select(maxfd + 1, &fds, NULL, NULL, &tv);
 
-            int len = read(fd_rot, buf, sizeof(buf) - 1);
-            if (len > 0) {
-                buf[len] = '\0';
+        if (r > 0 && watch_rtc && FD_ISSET(fd_rtc, &fds))
+            read_rtc();
 
-                if (sscanf(buf, "%ld %d", &rotary_val, &btn) >= 1) {
-                    if (!synced) {
-                        last_rotary_val = rotary_val;
-                        synced = 1;
-                    }
-
-                    rotary_delta = rotary_val - last_rotary_val;
-                    last_rotary_val = rotary_val;
+        if (r > 0 && FD_ISSET(fd_rot, &fds)) {
+            struct rotary_record recs[16];
 
-                    if (btn == 0) { // press
-                        if (!is_holding) {
-                            clock_gettime(CLOCK_MONOTONIC, &press_start);
-                            is_holding = 1;
-                        }
-                    } else { // release
-                        if (is_holding) {
-                            struct timespec now;
-                            clock_gettime(CLOCK_MONOTONIC, &now);
-                            long held = now.tv_sec - press_start.tv_sec;
-
-                            if (held >= 2) {
-                                /* ===== 2초 홀드 ===== */
-                                if (current_state == STATE_CLOCK) {
-                                    if (clock_mode == CLOCK_VIEW) {
-                                        /* 수정 모드 진입 */
-                                        int y,m,d,hh,mm,ss;
-                                        if (sscanf(rtc_cache, "%d-%d-%d %d:%d:%d",
-                                                   &y,&m,&d,&hh,&mm,&ss) == 6) {
-                                            edit_year = y;
-                                            edit_mon  = m;
-                                            edit_day  = d;
-                                            edit_hour = hh;
-                                            edit_min  = mm;
-                                            edit_sec  = ss;
-                                        } else {
-                                            edit_year=2000; edit_mon=1; edit_day=1;
-                                            edit_hour=0; edit_min=0; edit_sec=0;
-                                        }
-                                        edit_field = 0;
-                                        clock_mode = CLOCK_EDIT;
-                                    } else {
-                                        /* 저장 (드라이버 포맷: YY MM DD HH MM SS WD) */
-                                        int yy = edit_year % 100;
-                                        char cmd[64];
-                                        snprintf(cmd, sizeof(cmd),
-                                                 "%02d %02d %02d %02d %02d %02d 1",
-                                                 yy, edit_mon, edit_day,
-                                                 edit_hour, edit_min, edit_sec);
-                                        write(fd_rtc, cmd, strlen(cmd));
-                                        clock_mode = CLOCK_VIEW;
-                                    }
-                                } else if (current_state == STATE_GAME) {
-                                    /* GAME: 홀드하면 메뉴 */
-                                    current_state = STATE_MENU;
-                                } else {
-                                    /* MENU/WORLD에서는 홀드 동작 없음 */
-                                }
-                            } else {
-                                /* ===== 짧은 클릭 ===== */
-                                if (current_state == STATE_MENU) {
-                                    current_state = (AppState)(menu_index + 1);
-                                }
-                                else if (current_state == STATE_CLOCK) {
-                                    if (clock_mode == CLOCK_VIEW) {
-                                        /* CLOCK VIEW: 나가기 */
-                                        current_state = STATE_MENU;
-                                    } else {
-                                        /* CLOCK EDIT: 다음 필드 */
-                                        edit_field = (edit_field + 1) % 6;
-                                    }
-                                }
-                                else if (current_state == STATE_WORLD) {
-                                    /* WORLD: 나가기 */
-                                    current_state = STATE_MENU;
-                                }
-                                else if (current_state == STATE_GAME) {
-                                    /* GAME OVER면 클릭으로 재시작 */
-                                    if (game_over) reset_game();
-                                }
-                            }
-
-                            is_holding = 0;
-                        }
-                    }
-                }
-            }
+            /* 한 번의 read로 쌓인 이벤트를 최대 16개까지 받음 */
+            int len = read(fd_rot, recs, sizeof(recs));
+            for (int i = 0; len > 0 && i < len / (int)sizeof(recs[0]); i++)
+                handle_rotary_event(recs[i].value, recs[i].button, recs[i].timestamp_ns);
         }
 
         /* CLOCK_EDIT 상태에서 로터리로 값 변경 */
@@ -436,7 +494,7 @@ int main(void) {
             if (edit_mon > 12) edit_mon = 12;
 
             if (edit_day < 1) edit_day = 1;
-            if (edit_day > 31) edit_day = 31;
+            if (edit_day > month_days(edit_year, edit_mon)) edit_day = month_days(edit_year, edit_mon);
 
             if (edit_hour < 0) edit_hour = 0;
             if (edit_hour > 23) edit_hour = 23;
@@ -457,9 +515,13 @@ int main(void) {
             default:          handle_menu();  break;
         }
 
-        write(fd_oled, fb, sizeof(fb));
+        ioctl(fd_oled, SSD1306_IOC_FLUSH);
+
+        /* 이번 프레임에서 쓰지 않은 회전량은 버림 */
+        rotary_delta = 0;
     }
 
+    munmap(fb, SSD1306_FB_SIZE);
     close(fd_oled);
     close(fd_rot);
     close(fd_rtc);